@@ -0,0 +1,64 @@
+#include "libc.h"
+
+// The kernel maps its clock read only at 0xF0002000, so timestamps
+// come from the TSC without a syscall
+
+#define READS 100000
+#define JIFFIES 50
+
+// back to back reads never go backwards
+void monotonic(void)
+{
+    unsigned long long last = clock_ns();
+    int ok = 1;
+    for (int i = 0; i < READS; i++)
+    {
+        unsigned long long now = clock_ns();
+        ok = ok && now >= last;
+        last = now;
+    }
+    printf("*** monotonic %s\n", ok ? "ok" : "failed");
+}
+
+// it keeps time with the timer tick
+void rate(void)
+{
+    const struct timepage* t = TIMEPAGE;
+    unsigned start_jiffies = t->jiffies;
+    unsigned long long start = clock_ns();
+    while (t->jiffies - start_jiffies < JIFFIES)
+    {
+    }
+    // well under the 4 seconds that fit in 32 bits of nanoseconds
+    unsigned ms = (unsigned)(clock_ns() - start) / 1000000;
+
+    // a generous window, emulators are loose with both clocks
+    unsigned expected = JIFFIES * 1000 / t->hz;
+    int ok = t->hz == 1000 && ms >= expected / 2 && ms <= expected * 2;
+    printf("*** rate %s\n", ok ? "ok" : "failed");
+    printf("rate: %u ms for %u jiffies\n", ms, JIFFIES);
+}
+
+// users can only read it
+void read_only(void)
+{
+    int id = fork();
+    if (id == 0)
+    {
+        *(volatile unsigned*)&TIMEPAGE->jiffies = 0;
+        exit(0);
+    }
+    int rc = join();
+    printf("*** read only %s\n", rc == 139 ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** clock\n");
+    monotonic();
+    rate();
+    read_only();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
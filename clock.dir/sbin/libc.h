@@ -0,0 +1,87 @@
+#ifndef _LIBC_H_
+#define _LIBC_H_
+
+#include "sys.h"
+
+#define MISSING() do { \
+    putstr("\n*** missing code at"); \
+    putstr(__FILE__); \
+    putdec(__LINE__); \
+} while (0)
+
+extern void* malloc(size_t size);
+extern void free(void*);
+extern void* realloc(void* ptr, size_t newSize);
+
+void* memset(void* p, int val, size_t sz);
+void* memcpy(void* dest, void* src, size_t n);
+
+extern size_t strlen(const char* p);
+extern int strcmp(const char* a, const char* b);
+
+/* buffered output, see stdio.c */
+#define EOF (-1)
+#define BUFSIZ 1024
+
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
+typedef struct FILE {
+    int fd;
+    int mode;          /* _IOFBF, _IOLBF or _IONBF, -1 until the first write asks isatty */
+    size_t len;        /* how much of buf is waiting to be written */
+    int lock;
+    struct FILE* next;
+    char buf[BUFSIZ];
+} FILE;
+
+extern FILE* stdout;
+extern FILE* stderr;
+
+extern int fputc(int c, FILE* f);
+extern int fputs(const char* s, FILE* f);
+extern size_t fwrite(const void* p, size_t size, size_t n, FILE* f);
+extern int fflush(FILE* f);
+extern int setvbuf(FILE* f, char* buf, int mode, size_t size);
+extern FILE* fdopen(int fd, const char* mode);
+extern int fclose(FILE* f);
+
+extern int putchar(int c);
+extern int puts(const char *p);
+
+extern int printf(const char* fmt, ...);
+extern int isdigit(int c);
+
+// only traps into the kernel when contended. 0 unlocked, 1 locked, 2 locked with waiters
+struct mutex {
+    int state;
+};
+
+extern void mutex_lock(struct mutex* m);
+extern void mutex_unlock(struct mutex* m);
+
+struct cond {
+    int seq;
+};
+
+extern void cond_wait(struct cond* c, struct mutex* m);
+extern void cond_signal(struct cond* c);
+extern void cond_broadcast(struct cond* c);
+
+// the clock the kernel maps read only into every process.
+// nanoseconds since boot = ((rdtsc - tsc_base) * mult) >> shift
+struct timepage {
+    unsigned long long tsc_base;
+    unsigned mult;
+    unsigned shift;
+    unsigned hz;
+    volatile unsigned jiffies;
+};
+
+#define TIMEPAGE ((const struct timepage*)0xF0002000)
+
+// nanoseconds since boot, without a syscall
+extern unsigned long long clock_ns(void);
+
+#endif
@@ -0,0 +1,120 @@
+#include "libc.h"
+
+// This test times fork, exec and exit as the resident set of the parent grows,
+// and checks that the child still sees every page the parent wrote
+
+#define PAGE_SIZE 4096
+#define ITERS 8
+
+unsigned rss_pages[] = {0, 16, 64, 256, 1024};
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// write a pattern into every page so they are all resident
+void touch(unsigned *mem, unsigned pages)
+{
+    for (unsigned i = 0; i < pages; i++)
+    {
+        mem[i * (PAGE_SIZE / sizeof(unsigned))] = i * 7 + 1;
+    }
+}
+
+int check(unsigned *mem, unsigned pages)
+{
+    for (unsigned i = 0; i < pages; i++)
+    {
+        if (mem[i * (PAGE_SIZE / sizeof(unsigned))] != i * 7 + 1)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void bench(unsigned pages)
+{
+    unsigned *mem = 0;
+    if (pages != 0)
+    {
+        mem = simple_mmap(0, pages * PAGE_SIZE, -1, 0);
+        if (mem == 0)
+        {
+            printf("*** mmap of %u pages failed\n", pages);
+            return;
+        }
+        touch(mem, pages);
+    }
+
+    unsigned fork_total = 0;
+    unsigned exit_total = 0;
+    unsigned exec_total = 0;
+    int bad = 0;
+
+    // fork then exit straight away, after checking the memory
+    for (int i = 0; i < ITERS; i++)
+    {
+        unsigned start = cycles();
+        int id = fork();
+        if (id == 0)
+        {
+            exit(check(mem, pages));
+        }
+        unsigned forked = cycles();
+        if (join() != 0)
+        {
+            bad = 1;
+        }
+        unsigned joined = cycles();
+        fork_total += forked - start;
+        exit_total += joined - forked;
+    }
+
+    // fork then replace the child with a program that exits
+    for (int i = 0; i < ITERS; i++)
+    {
+        unsigned start = cycles();
+        int id = fork();
+        if (id == 0)
+        {
+            execl("/sbin/init", "init", "exit", 0);
+            exit(1);
+        }
+        if (join() != 0)
+        {
+            bad = 1;
+        }
+        exec_total += cycles() - start;
+    }
+
+    printf("*** %u pages %s\n", pages, bad ? "failed" : "ok");
+    printf("rss %u pages: fork %u cycles, exit+join %u cycles, fork+exec+exit %u cycles\n",
+           pages, fork_total / ITERS, exit_total / ITERS, exec_total / ITERS);
+
+    if (mem != 0)
+    {
+        simple_munmap(mem);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // the exec target of the benchmark
+    if (argc > 1 && strcmp(argv[1], "exit") == 0)
+    {
+        return 0;
+    }
+
+    printf("*** fork benchmark\n");
+    for (unsigned i = 0; i < sizeof(rss_pages) / sizeof(rss_pages[0]); i++)
+    {
+        bench(rss_pages[i]);
+    }
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include "libc.h"
+
+int putchar(int c) {
+    return fputc(c, stdout);
+}
+
+int puts(const char* p) {
+    if (fputs(p, stdout) < 0 || fputc('\n', stdout) < 0) return EOF;
+    return strlen(p) + 1;
+}
+
+size_t strlen(const char* p) {
+    size_t n = 0;
+    while (p[n] != 0) n++;
+    return n;
+}
+
+int strcmp(const char* a, const char* b) {
+    while (*a != 0 && *a == *b) {
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
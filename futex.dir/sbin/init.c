@@ -0,0 +1,126 @@
+#include "libc.h"
+
+// Processes share the VA_USER_SHARED page and synchronize through
+// futex-backed mutexes and condition variables living in it
+
+#define WORKERS 4
+#define INCREMENTS 2000
+#define ROUNDS 200
+
+struct shared {
+    struct mutex m;
+    int counter;
+    struct cond c;
+    int turn;
+    int word;
+};
+
+// clear of the fault address the kernel writes at 0xF0000800
+#define SHARED ((struct shared*)0xF0000100)
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// everyone bumps one counter under the same lock
+void mutex_counter(void)
+{
+    struct shared* s = SHARED;
+    s->m.state = 0;
+    s->counter = 0;
+
+    unsigned start = cycles();
+    for (int w = 0; w < WORKERS; w++)
+    {
+        if (fork() == 0)
+        {
+            for (int i = 0; i < INCREMENTS; i++)
+            {
+                mutex_lock(&s->m);
+                s->counter = s->counter + 1;
+                mutex_unlock(&s->m);
+            }
+            exit(0);
+        }
+    }
+    for (int w = 0; w < WORKERS; w++)
+    {
+        join();
+    }
+    unsigned total = cycles() - start;
+
+    printf("*** mutex %s\n", s->counter == WORKERS * INCREMENTS ? "ok" : "failed");
+    printf("mutex: %u cycles per lock and unlock\n", total / (WORKERS * INCREMENTS));
+}
+
+// two processes take turns, waiting on a condition variable for the other
+void cond_ping_pong(void)
+{
+    struct shared* s = SHARED;
+    s->m.state = 0;
+    s->c.seq = 0;
+    s->turn = 0;
+
+    if (fork() == 0)
+    {
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            mutex_lock(&s->m);
+            while (s->turn != 1)
+            {
+                cond_wait(&s->c, &s->m);
+            }
+            s->turn = 0;
+            cond_broadcast(&s->c);
+            mutex_unlock(&s->m);
+        }
+        exit(0);
+    }
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        mutex_lock(&s->m);
+        s->turn = 1;
+        cond_broadcast(&s->c);
+        while (s->turn != 0)
+        {
+            cond_wait(&s->c, &s->m);
+        }
+        mutex_unlock(&s->m);
+    }
+    int rc = join();
+
+    printf("*** cond %s\n", rc == 0 ? "ok" : "failed");
+}
+
+// the syscalls themselves
+void futex_calls(void)
+{
+    struct shared* s = SHARED;
+    s->word = 7;
+
+    int mismatch = futex_wait(&s->word, 8);
+    int nobody = futex_wake(&s->word, 1);
+    int unaligned = futex_wait((int*)((char*)&s->word + 1), 7);
+    int kernel = futex_wait((int*)0x1000, 0);
+
+    // a private page works too, it just has nobody else on it
+    int mine = 3;
+    int own = futex_wait(&mine, 4);
+
+    int ok = mismatch == 1 && nobody == 0 && unaligned == -1 && kernel == -1 && own == 1;
+    printf("*** futex calls %s\n", ok ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** futex\n");
+    futex_calls();
+    mutex_counter();
+    cond_ping_pong();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "libc.h"
+
+int putchar(int c) {
+    return fputc(c, stdout);
+}
+
+int puts(const char* p) {
+    if (fputs(p, stdout) < 0 || fputc('\n', stdout) < 0) return EOF;
+    return strlen(p) + 1;
+}
+
+size_t strlen(const char* p) {
+    size_t n = 0;
+    while (p[n] != 0) n++;
+    return n;
+}
+
+int strcmp(const char* a, const char* b) {
+    while (*a != 0 && *a == *b) {
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+void mutex_lock(struct mutex* m) {
+    int c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (c != 2) {
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        futex_wait(&m->state, 2);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void mutex_unlock(struct mutex* m) {
+    if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex_wake(&m->state, 1);
+    }
+}
+
+void cond_wait(struct cond* c, struct mutex* m) {
+    int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+    mutex_unlock(m);
+    futex_wait(&c->seq, seq);
+    mutex_lock(m);
+}
+
+void cond_signal(struct cond* c) {
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&c->seq, 1);
+}
+
+void cond_broadcast(struct cond* c) {
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&c->seq, 0x7fffffff);
+}
@@ -0,0 +1,149 @@
+#include "libc.h"
+
+// readv and writev move several buffers in one system call
+
+#define RECORDS 200
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// the line itself is three segments
+void to_terminal(void)
+{
+    struct iovec iov[3] = {
+        { "*** ", 4 },
+        { "writev", 6 },
+        { " ok\n", 4 },
+    };
+    int n = writev(1, iov, 3);
+    if (n != 14)
+    {
+        printf("*** writev returned %d\n", n);
+    }
+}
+
+// the file is read as a header, a body and whatever is left
+void from_file(void)
+{
+    int fd = open("/data.txt");
+    char digits[11] = { 0 };
+    char letters[7] = { 0 };
+    char rest[100] = { 0 };
+    struct iovec iov[3] = {
+        { digits, 10 },
+        { letters, 6 },
+        { rest, sizeof(rest) },
+    };
+    int n = readv(fd, iov, 3);
+    int again = readv(fd, iov, 3);
+    close(fd);
+
+    int ok = n == 37 && again == 0 &&
+             strcmp(digits, "0123456789") == 0 &&
+             strcmp(letters, "abcdef") == 0 &&
+             strcmp(rest, "ghijklmnopqrstuvwxyz\n") == 0;
+    printf("*** file %s\n", ok ? "ok" : "failed");
+}
+
+// split one way going in and another way coming out
+void through_pipe(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    if (fork() == 0)
+    {
+        struct iovec iov[3] = {
+            { "head", 4 },
+            { ":", 1 },
+            { "body of the record", 18 },
+        };
+        exit(writev(w, iov, 3) == 23 ? 0 : 1);
+    }
+    char a[10] = { 0 };
+    char b[14] = { 0 };
+    struct iovec iov[2] = {
+        { a, 9 },
+        { b, 14 },
+    };
+    int n = readv(r, iov, 2);
+    int rc = join();
+    close(w);
+    close(r);
+
+    int ok = n == 23 && rc == 0 && strcmp(a, "head:body") == 0 && strcmp(b, " of the record") == 0;
+    printf("*** pipe %s\n", ok ? "ok" : "failed");
+}
+
+void bad_vectors(void)
+{
+    char c;
+    struct iovec one = { &c, 1 };
+    struct iovec kernel = { (void*)0x1000, 1 };
+    struct iovec many[65];
+    for (int i = 0; i < 65; i++)
+    {
+        many[i] = one;
+    }
+
+    int ok = writev(1, &one, 0) == -1 &&
+             writev(1, many, 65) == -1 &&
+             writev(1, &kernel, 1) == -1 &&
+             writev(1, (struct iovec*)0x1000, 1) == -1 &&
+             readv(9, &one, 1) == -1;
+    printf("*** bad %s\n", ok ? "ok" : "failed");
+}
+
+// records of a length and a payload through a pipe, one call each against two
+unsigned time_records(int vectored)
+{
+    int w, r;
+    pipe(&w, &r);
+    if (fork() == 0)
+    {
+        char buf[12];
+        for (int i = 0; i < RECORDS; i++)
+        {
+            read(r, buf, sizeof(buf));
+        }
+        exit(0);
+    }
+    int len = 8;
+    char payload[8] = "payload";
+    unsigned start = cycles();
+    for (int i = 0; i < RECORDS; i++)
+    {
+        if (vectored)
+        {
+            struct iovec iov[2] = { { &len, 4 }, { payload, 8 } };
+            writev(w, iov, 2);
+        }
+        else
+        {
+            write(w, &len, 4);
+            write(w, payload, 8);
+        }
+    }
+    unsigned total = cycles() - start;
+    join();
+    close(w);
+    close(r);
+    return total / RECORDS;
+}
+
+int main()
+{
+    printf("*** iovec\n");
+    to_terminal();
+    from_file();
+    through_pipe();
+    bad_vectors();
+    printf("write: %u cycles per record\n", time_records(0));
+    printf("writev: %u cycles per record\n", time_records(1));
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
@@ -10,5 +10,25 @@ void pause() {
     asm volatile("pause");
 }
 
+// ProfiledLocks can be made before constructors run (the heap's is), so no constructor here
+static ProfiledLock* all_profiled_locks = nullptr;
+static TasLock profiled_locks_lock{};
+
+ProfiledLock::ProfiledLock(const char* name) : it(), name(name), next_lock(nullptr), acquisitions(0), contended(0), spins(0), held_since(0), max_hold(0) {
+    if (LOCK_STATS) {
+        LockGuard g{profiled_locks_lock};
+        next_lock = all_profiled_locks;
+        all_profiled_locks = this;
+    }
+}
+
+void ProfiledLock::dump_all() {
+    for (ProfiledLock* p = all_profiled_locks; p != nullptr; p = p->next_lock) {
+        uint32_t max_hold = p->max_hold > 0xffffffff ? 0xffffffff : (uint32_t)p->max_hold;
+        Debug::printf("| lock %s: %u acquisitions, %u contended, %u spins, max hold %u cycles\n",
+                      p->name, p->acquisitions, p->contended, p->spins, max_hold);
+    }
+}
+
 
 
@@ -1,6 +1,7 @@
 #ifndef _ATOMIC_H_
 #define _ATOMIC_H_
 
+#include "config.h"
 #include "machine.h"
 #include "init.h"
 #include "loop.h"
@@ -55,6 +56,16 @@ public:
     T add_fetch(T inc) {
         return __atomic_add_fetch(&value,inc,__ATOMIC_SEQ_CST);
     }
+    T fetch_or(T bits) {
+        return __atomic_fetch_or(&value,bits,__ATOMIC_SEQ_CST);
+    }
+    // on failure expected gets what was actually there
+    bool compare_exchange(T& expected, T desired) {
+        return __atomic_compare_exchange_n(&value,&expected,desired,false,__ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST);
+    }
+    T fetch_and(T bits) {
+        return __atomic_fetch_and(&value,bits,__ATOMIC_SEQ_CST);
+    }
     void set(T inc) {
         return __atomic_store_n(&value,inc,__ATOMIC_SEQ_CST);
     }
@@ -117,12 +128,16 @@ public:
 
 extern void pause();
 
-class SpinLock {
+/**
+ * test and set lock, one byte big but unfair and every waiter bounces the line.
+ * good for the big arrays of rarely contended locks
+ */
+class TasLock {
     Atomic<bool> taken;
 public:
-    SpinLock() : taken(false) {}
+    TasLock() : taken(false) {}
 
-    SpinLock(const SpinLock&) = delete;
+    TasLock(const TasLock&) = delete;
 
     // for debugging, etc. Allows false positives
     bool isMine() {
@@ -142,4 +157,93 @@ public:
     }
 };
 
+/**
+ * ticket lock, cores get the lock in the order they asked for it
+ * and waiting only reads the line until the holder hands it over
+ */
+class SpinLock {
+    Atomic<uint16_t> next;
+    Atomic<uint16_t> serving;
+public:
+    SpinLock() : next(0), serving(0) {}
+
+    SpinLock(const SpinLock&) = delete;
+
+    // for debugging, etc. Allows false positives
+    bool isMine() {
+        return next.get() != serving.get();
+    }
+
+    // returns how many times we had to wait
+    uint32_t acquire(void) {
+        uint16_t mine = next.fetch_add(1);
+        uint32_t spins = 0;
+        while (serving.get() != mine) {
+            serving.monitor_value();
+            if (serving.get() != mine) {
+                iAmStuckInALoop(true);
+            }
+            spins++;
+        }
+        return spins;
+    }
+
+    void lock(void) {
+        acquire();
+    }
+
+    void unlock(void) {
+        // only the holder writes serving
+        serving.set(serving.get() + 1);
+    }
+};
+
+/**
+ * a SpinLock with a name that counts how contended it is when LOCK_STATS is on,
+ * meant for the few global locks everyone goes through
+ */
+class ProfiledLock {
+    SpinLock it;
+    const char* const name;
+    ProfiledLock* next_lock;
+    uint32_t acquisitions;
+    uint32_t contended;
+    uint32_t spins;
+    uint64_t held_since;
+    uint64_t max_hold;
+public:
+    explicit ProfiledLock(const char* name);
+
+    ProfiledLock(const ProfiledLock&) = delete;
+
+    bool isMine() {
+        return it.isMine();
+    }
+
+    void lock(void) {
+        uint32_t waited = it.acquire();
+        if (LOCK_STATS) {
+            acquisitions++;
+            if (waited != 0) {
+                contended++;
+                spins += waited;
+            }
+            held_since = rdtsc();
+        }
+    }
+
+    void unlock(void) {
+        if (LOCK_STATS) {
+            uint64_t held = rdtsc() - held_since;
+            if (held > max_hold) {
+                max_hold = held;
+            }
+        }
+        it.unlock();
+    }
+
+    // prints the counters of every ProfiledLock
+    static void dump_all();
+};
+
 #endif
@@ -2,6 +2,7 @@
 
 #include "semaphore.h"
 #include "queue.h"
+#include "watch.h"
 
 // A bounded buffer is a generalization of a channel
 // that has a buffer size "n > 0"
@@ -18,6 +19,14 @@ class BoundedBuffer {
     Queue<ValueNode, SpinLock> q;
 
    public:
+    // told whenever a value goes in or comes out
+    WatchList watchers;
+
+    // a transfer of many values holds one of these from its first value to its last,
+    // so two readers or two writers never interleave
+    Semaphore reading{1};
+    Semaphore writing{1};
+
     // construct a BB with a buffer size of n
     BoundedBuffer(uint32_t n) : sem_send(n), sem_receive(0), q{} {}
     BoundedBuffer(const BoundedBuffer&) = delete;
@@ -31,6 +40,7 @@ class BoundedBuffer {
         q.add(new ValueNode(v));
         sem_send.down([this, v, work] {
             sem_receive.up();
+            watchers.notify();
             work();
         });
     }
@@ -51,8 +61,91 @@ class BoundedBuffer {
         sem_receive.down([this, work] {
             ValueNode* val_node = q.remove();
             sem_send.up();
+            watchers.notify();
             work(val_node->v);
             delete val_node;
         });
     }
+
+    // whether a take or a give would go through right now, someone else may get there first
+    bool can_take() {
+        return sem_receive.is_up();
+    }
+
+    bool can_give() {
+        return sem_send.is_up();
+    }
+
+    // takes the first value into v if there is one, without waiting
+    bool try_take(T& v) {
+        if (!sem_receive.await_ready()) {
+            return false;
+        }
+        ValueNode* val_node = q.remove();
+        sem_send.up();
+        watchers.notify();
+        v = val_node->v;
+        delete val_node;
+        return true;
+    }
+
+    ////////////////////////////////////////
+    // A bounded buffer is also awaitable //
+    ////////////////////////////////////////
+
+    class Take {
+        BoundedBuffer& bb;
+
+       public:
+        explicit Take(BoundedBuffer& bb) : bb(bb) {}
+
+        bool await_ready() noexcept {
+            return bb.sem_receive.await_ready();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            bb.sem_receive.down(handle);
+        }
+
+        T await_resume() noexcept {
+            ValueNode* val_node = bb.q.remove();
+            bb.sem_send.up();
+            bb.watchers.notify();
+            T v = val_node->v;
+            delete val_node;
+            return v;
+        }
+    };
+
+    class Give {
+        BoundedBuffer& bb;
+        T const v;
+
+       public:
+        Give(BoundedBuffer& bb, T v) : bb(bb), v(v) {}
+
+        bool await_ready() noexcept {
+            return bb.sem_send.await_ready();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            bb.sem_send.down(handle);
+        }
+
+        void await_resume() noexcept {
+            bb.q.add(new ValueNode(v));
+            bb.sem_receive.up();
+            bb.watchers.notify();
+        }
+    };
+
+    // the first value, once there is one
+    Take take() {
+        return Take(*this);
+    }
+
+    // puts v in the next slot, once there is room
+    Give give(T v) {
+        return Give(*this, v);
+    }
 };
@@ -12,6 +12,10 @@ struct ApicInfo {
 typedef struct ApicInfo ApicInfo;
 
 #define MAX_PROCS 16
+#define CACHE_LINE 64
+
+// set to 1 to have ProfiledLock count contention and dump it at shutdown
+#define LOCK_STATS 0
 
 struct Config {
     uint32_t memSize;
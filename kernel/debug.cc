@@ -42,6 +42,7 @@ void Debug::shutdown() {
             printf("passed %d checks\n",checks.get());
         }
     }
+    ProfiledLock::dump_all();
     printf("shutdown\n",SMP::me());
     shutdown_called = true;
     while (true) {
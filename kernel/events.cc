@@ -1,7 +1,36 @@
 #include "events.h"
+#include "heap.h"
+#include "process.h"
+#include "rcu.h"
 
 namespace impl {
-Queue<Event, SpinLock> ready_queue{};
+Queue<Event, LockFree> ready_queue{};
+Queue<Event, LockFree> idle_queue{};
+
+// how many ready events a core runs before it lets an idle event in
+constexpr uint32_t IDLE_EVERY = 64;
+
+// how many ready events a core runs before its own ordered events get a turn anyway
+constexpr uint32_t ORDERED_EVERY = 8;
+
+Atomic<uint32_t> halted_cores{0};
+Atomic<uint32_t> mwaiting_cores{0};
+
+void wake_one(Atomic<uint32_t>& cores) {
+    uint32_t me = 1 << SMP::me();
+    while (true) {
+        uint32_t sleeping = cores.get() & ~me;
+        if (sleeping == 0) {
+            return;
+        }
+        // claim it so nobody else sends it an IPI too
+        uint32_t bit = sleeping & -sleeping;
+        if (cores.fetch_and(~bit) & bit) {
+            SMP::wake(__builtin_ctz(bit));
+            return;
+        }
+    }
+}
 
 struct PQEntry {
     uint32_t const at;
@@ -12,9 +41,10 @@ struct PQEntry {
 
 struct PQ {
     PQEntry* head = nullptr;
-    SpinLock lock{};  // is this wise? no because add is O(n)
+    ProfiledLock lock{"timers"};  // is this wise? no because add is O(n)
 
-    void add(uint32_t const at, Event* e) {
+    // returns whether it is now the earliest timer
+    bool add(uint32_t const at, Event* e) {
         auto pqe = new PQEntry(at, e);
         lock.lock();
         auto p = head;
@@ -27,6 +57,7 @@ struct PQ {
         pqe->next = p;
         *pprev = pqe;
         lock.unlock();
+        return pprev == &head;
     }
 
     Event* remove_if_ready() {
@@ -46,13 +77,245 @@ struct PQ {
         lock.unlock();
         return nullptr;
     }
+
+    // when the earliest timer is due, or 0xffffffff if there is none
+    uint32_t next_at() {
+        LockGuard g{lock};
+        return head == nullptr ? 0xffffffff : head->at;
+    }
 } pq;
 
 void timed(const uint32_t at, Event* e) {
-    pq.add(at, e);
+    // sleeping cores only set their timers for the old earliest one
+    if (pq.add(at, e)) {
+        if (halted_cores.get() != 0) {
+            wake_one(halted_cores);
+        } else if (mwaiting_cores.get() != 0) {
+            wake_one(mwaiting_cores);
+        }
+    }
 }
 
+struct OrderedEntry {
+    uint64_t key;
+    uint32_t const allowed;
+    Event* e;
+    OrderedEntry* next = nullptr;
+    OrderedEntry(uint64_t const key, uint32_t const allowed, Event* e) : key(key), allowed(allowed), e(e) {}
+};
+
+struct OrderedQueue {
+    OrderedEntry* head = nullptr;
+    uint32_t count = 0;
+    uint64_t floor = 0;
+    ProfiledLock lock{"runqueue"};  // add is O(n) like the timers, fine for a handful of processes
+
+    // call with the lock held
+    void insert(OrderedEntry* oe) {
+        auto p = head;
+        auto pprev = &head;
+        // equal keys keep their arrival order
+        while (p != nullptr) {
+            if (p->key > oe->key) break;
+            pprev = &p->next;
+            p = p->next;
+        }
+        oe->next = p;
+        *pprev = oe;
+        count++;
+    }
+
+    // takes out the lowest, nullptr if there is none
+    Event* remove(uint64_t& key) {
+        lock.lock();
+        auto oe = head;
+        if (oe == nullptr) {
+            lock.unlock();
+            return nullptr;
+        }
+        head = oe->next;
+        count--;
+        if (oe->key > floor) {
+            floor = oe->key;
+        }
+        lock.unlock();
+        key = oe->key;
+        auto e = oe->e;
+        delete oe;
+        return e;
+    }
+
+    // takes out the lowest entry that may run on the given core, call with the lock held
+    OrderedEntry* remove_for(uint32_t core) {
+        auto p = head;
+        auto pprev = &head;
+        while (p != nullptr) {
+            if ((p->allowed & (1 << core)) != 0) {
+                *pprev = p->next;
+                count--;
+                return p;
+            }
+            pprev = &p->next;
+            p = p->next;
+        }
+        return nullptr;
+    }
+
+    bool is_empty() {
+        return head == nullptr;
+    }
+};
+
+PerCPU<OrderedQueue> ordered{};
+
+// whether the core is running an ordered event right now, it counts towards its load
+PerCPU<bool> running_ordered{};
+PerCPU<uint64_t> running_key{};
+
 PerCPU<Event*> pending_event{};
+PerCPU<uint32_t> since_idle{};
+PerCPU<uint32_t> since_ordered{};
+
+// gets a sleeping core out of hlt or mwait, it only watches the ready queue
+static void wake_core(uint32_t core) {
+    if (core == SMP::me()) {
+        return;
+    }
+    uint32_t bit = 1 << core;
+    if ((halted_cores.fetch_and(~bit) & bit) || (mwaiting_cores.fetch_and(~bit) & bit)) {
+        SMP::wake(core);
+    }
+}
+
+void add_ordered(uint32_t core, uint64_t key, uint32_t allowed, Event* e) {
+    auto oe = new OrderedEntry(key, allowed, e);
+    OrderedQueue& q = ordered.forCPU(core);
+    q.lock.lock();
+    q.insert(oe);
+    q.lock.unlock();
+    wake_core(core);
+}
+
+uint64_t lowest_ordered() {
+    OrderedQueue& q = ordered.mine();
+    LockGuard g{q.lock};
+    return q.head == nullptr ? 0xffffffffffffffff : q.head->key;
+}
+
+uint64_t ordered_floor(uint32_t core) {
+    OrderedQueue& q = ordered.forCPU(core);
+    LockGuard g{q.lock};
+    return q.floor;
+}
+
+uint64_t dispatched_key() {
+    return running_key.mine();
+}
+
+uint32_t ordered_load(uint32_t core) {
+    return ordered.forCPU(core).count + (running_ordered.forCPU(core) ? 1 : 0);
+}
+
+// how much busier than the idlest core a core has to be before we move work off it
+constexpr uint32_t IMBALANCE_THRESHOLD = 1;
+
+void balance_ordered() {
+    uint32_t total = kConfig.totalProcs;
+    while (true) {
+        uint32_t busiest = 0;
+        uint32_t idlest = 0;
+        for (uint32_t i = 1; i < total; i++) {
+            if (ordered_load(i) > ordered_load(busiest)) busiest = i;
+            if (ordered_load(i) < ordered_load(idlest)) idlest = i;
+        }
+        if (ordered_load(busiest) <= ordered_load(idlest) + IMBALANCE_THRESHOLD) {
+            return;
+        }
+
+        // always lock the lower core first so two balancers can't deadlock
+        OrderedQueue& from = ordered.forCPU(busiest);
+        OrderedQueue& to = ordered.forCPU(idlest);
+        OrderedQueue& first = busiest < idlest ? from : to;
+        OrderedQueue& second = busiest < idlest ? to : from;
+        first.lock.lock();
+        second.lock.lock();
+        OrderedEntry* oe = from.remove_for(idlest);
+        if (oe != nullptr) {
+            // keys only mean something next to the others on the same core
+            oe->key = oe->key - from.floor + to.floor;
+            to.insert(oe);
+        }
+        second.lock.unlock();
+        first.lock.unlock();
+
+        // nothing on the busy core may run there, leave it
+        if (oe == nullptr) {
+            return;
+        }
+        wake_core(idlest);
+    }
+}
+
+// the next ordered event for this core, nullptr if it has none
+static Event* take_ordered() {
+    uint64_t key;
+    Event* e = ordered.mine().remove(key);
+    if (e != nullptr) {
+        since_ordered.mine() = 0;
+        running_ordered.mine() = true;
+        running_key.mine() = key;
+    }
+    return e;
+}
+
+struct FreeEvent {
+    FreeEvent* next;
+};
+
+struct EventPool {
+    FreeEvent* first = nullptr;
+    uint32_t count = 0;
+};
+
+// more than this many free events on a core go back to the heap
+constexpr uint32_t MAX_FREE_EVENTS = 256;
+
+PerCPU<EventPool> event_pools{};
+
+// interrupt handlers make events too, so keep them out while we touch our pool
+void* alloc_event(size_t bytes) {
+    if (bytes > EVENT_SLOT_BYTES) {
+        return malloc(bytes);
+    }
+    bool wasDisabled = disable();
+    EventPool& pool = event_pools.mine();
+    FreeEvent* it = pool.first;
+    if (it != nullptr) {
+        pool.first = it->next;
+        pool.count--;
+    }
+    enable(wasDisabled);
+    return it != nullptr ? it : malloc(EVENT_SLOT_BYTES);
+}
+
+void free_event(void* p, size_t bytes) {
+    if (bytes <= EVENT_SLOT_BYTES) {
+        bool wasDisabled = disable();
+        EventPool& pool = event_pools.mine();
+        bool keep = pool.count < MAX_FREE_EVENTS;
+        if (keep) {
+            FreeEvent* it = (FreeEvent*)p;
+            it->next = pool.first;
+            pool.first = it;
+            pool.count++;
+        }
+        enable(wasDisabled);
+        if (keep) {
+            return;
+        }
+    }
+    free(p);
+}
 
 void manage_pending() {
     if (pending_event.mine() != nullptr) {
@@ -62,27 +325,89 @@ void manage_pending() {
     }
 }
 
+// nothing to run, so sleep until the next timer is due or someone wakes us
+void sleep() {
+    pause();  // still catches shutdown
+
+    // see if a busy core has something for us first
+    balance_ordered();
+    if (!ordered.mine().is_empty()) {
+        return;
+    }
+
+    // a sleeping core should not keep a dead process' page dir around
+    ProcessManagement::release_address_space();
+
+    // QEMU treats mwait as pause with more than one core, so only trust it on hardware
+    bool use_mwait = hasMwait && !onHypervisor;
+    Atomic<uint32_t>& sleeping = use_mwait ? mwaiting_cores : halted_cores;
+    uint32_t me = 1 << SMP::me();
+
+    // an interrupt handler adding work after the check would not wake us
+    bool was_enabled = (getFlags() & 0x200) != 0;
+    cli();
+
+    // announce ourselves before the last look, whoever adds work next sees us
+    sleeping.fetch_or(me);
+    Rcu::enter_idle();
+    if (use_mwait) {
+        ready_queue.monitor_add();
+    }
+    if (ready_queue.is_empty() && idle_queue.is_empty() && ordered.mine().is_empty()) {
+        Pit::idle(Pit::jiffies_until(pq.next_at()), use_mwait);
+    }
+    sleeping.fetch_and(~me);
+    Rcu::exit_idle();
+
+    if (was_enabled) sti();
+}
+
 }  // namespace impl
 
 void event_loop() {
     using namespace impl;
 
     manage_pending();
+    running_ordered.mine() = false;
 
     // Debug::printf("| core#%d entring event_loop\n", SMP::me());
     while (true) {
+        // nothing from the last event is still being read
+        Rcu::quiescent();
+
         while (true) {
             auto e = pq.remove_if_ready();
             if (e == nullptr) break;
             ready_queue.add(e);
         }
-        auto e = ready_queue.remove();
+        // idle work only jumps the line once it has waited long enough
+        Event* e = nullptr;
+        if (since_idle.mine() >= IDLE_EVERY) {
+            since_idle.mine() = 0;
+            e = idle_queue.remove();
+        }
+        // ordered work goes before the ready queue when it is empty or has had its share
+        if (e == nullptr && (since_ordered.mine() >= ORDERED_EVERY || ready_queue.is_empty())) {
+            e = take_ordered();
+        }
+        if (e == nullptr) {
+            e = ready_queue.remove();
+            since_idle.mine()++;
+            since_ordered.mine()++;
+        }
+        if (e == nullptr) {
+            e = take_ordered();
+        }
+        if (e == nullptr) {
+            e = idle_queue.remove();
+        }
         if (e == nullptr) {
-            pause();
+            sleep();
         } else {
             pending_event.mine() = e;
             e->doit();
             manage_pending();
+            running_ordered.mine() = false;
         }
     }
 }
@@ -6,6 +6,7 @@
 #include "shared.h"
 
 #include <coroutine>
+#include <type_traits>
 
 // Implementation details, we use a namespace to protect against
 // accidental direct use in test cases
@@ -13,22 +14,68 @@ namespace impl {
 
     // implementation hints, feel free to use, remove, replace, enhance, ...
 
+    // events up to this size are recycled through a per-CPU free list
+    constexpr size_t EVENT_SLOT_BYTES = 64;
+
+    extern void* alloc_event(size_t bytes);
+    extern void free_event(void* p, size_t bytes);
+
     struct Event {
         Event* next = nullptr;
         virtual void doit() = 0;
         virtual ~Event() {}
+
+        static void* operator new(size_t bytes) {
+            return alloc_event(bytes);
+        }
+
+        // the virtual destructor makes sure we get the size of the real event
+        static void operator delete(void* p, size_t bytes) {
+            free_event(p, bytes);
+        }
     };
 
     template <typename Work>
     struct EventWithWork: public Event {
         const Work work;
         explicit inline EventWithWork(const Work& work): work(work) {}
+        explicit inline EventWithWork(Work&& work): work(static_cast<Work&&>(work)) {}
         void doit() override {
             work();
         }
     };
 
-    extern Queue<Event, SpinLock> ready_queue;
+    // makes an event for the work, moving it in if we were given a temporary
+    template <typename Work>
+    inline Event* make_event(Work&& work) {
+        return new EventWithWork<std::remove_cvref_t<Work>>(static_cast<Work&&>(work));
+    }
+
+    extern Queue<Event, LockFree> ready_queue;
+
+    // work that only runs when a core has nothing better to do
+    extern Queue<Event, LockFree> idle_queue;
+
+    // cores sleeping in hlt, and cores sleeping in mwait on the ready queue
+    extern Atomic<uint32_t> halted_cores;
+    extern Atomic<uint32_t> mwaiting_cores;
+
+    // IPIs one sleeping core out of the given set
+    extern void wake_one(Atomic<uint32_t>& cores);
+
+    // call after adding work that a sleeping core should pick up.
+    // cores in mwait already woke up from the write to the queue
+    inline void new_work() {
+        if (halted_cores.get() != 0 && mwaiting_cores.get() == 0) {
+            wake_one(halted_cores);
+        }
+    }
+
+    // makes an event runnable
+    inline void make_ready(Event* e) {
+        ready_queue.add(e);
+        new_work();
+    }
 
     template <typename Work>
     void run_at(const uint32_t at, const Work& work) {
@@ -36,14 +83,38 @@ namespace impl {
             auto e = new EventWithWork([at, work] {
                 run_at(at, work);
             });
-            ready_queue.add(e);
+            make_ready(e);
         } else {
             auto e = new EventWithWork(work);
-            ready_queue.add(e);
+            make_ready(e);
         } 
     }
 
     extern void timed(const uint32_t at, Event* e);
+
+    // events that are not run in arrival order but lowest key first.
+    // each core has its own queue, allowed is the set of cores the event may be moved to
+    extern void add_ordered(uint32_t core, uint64_t key, uint32_t allowed, Event* e);
+
+    // the lowest waiting key on this core, or 0xffffffffffffffff if there is none
+    extern uint64_t lowest_ordered();
+
+    // the key of the last ordered event the core took out, it never goes down
+    extern uint64_t ordered_floor(uint32_t core);
+
+    // the key of the ordered event this core is running
+    extern uint64_t dispatched_key();
+
+    // how many ordered events the core has waiting or running
+    extern uint32_t ordered_load(uint32_t core);
+
+    // moves ordered events from the busiest core to the idlest until they are about even
+    extern void balance_ordered();
+
+    // whether anything besides the current work wants this core
+    inline bool work_waiting() {
+        return !ready_queue.is_empty() || !idle_queue.is_empty() || lowest_ordered() != 0xffffffffffffffff;
+    }
 }
 
 /******************/
@@ -53,18 +124,61 @@ namespace impl {
 // Schedules some conccurent work in the future.
 // No sooner than "ms" milli-seoncs
 template <typename Work>
-inline void go(const Work& work, uint32_t const delay=0) {
-    auto e = new impl::EventWithWork(work);
+inline void go(Work&& work, uint32_t const delay=0) {
+    auto e = impl::make_event(static_cast<Work&&>(work));
     if (delay == 0) {
-        impl::ready_queue.add(e);
+        impl::make_ready(e);
     } else {
         timed(Pit::jiffies+delay+1, e);
     }
 }
 
+// Schedules some concurrent work on the given core that competes with the core's other
+// ordered work by key, the lowest key goes first. It may be moved to any of the allowed cores
+template <typename Work>
+inline void go_ordered(uint32_t core, uint64_t key, uint32_t allowed, Work&& work) {
+    impl::add_ordered(core, key, allowed, impl::make_event(static_cast<Work&&>(work)));
+}
+
+// Schedules some background work that runs when a core would otherwise be idle.
+// It is never starved completely, the event loop picks it up every so often
+template <typename Work>
+inline void go_idle(Work&& work) {
+    auto e = impl::make_event(static_cast<Work&&>(work));
+    impl::idle_queue.add(e);
+    // mwait only watches the ready queue, so this can only get a halted core
+    if (impl::halted_cores.get() != 0) {
+        impl::wake_one(impl::halted_cores);
+    }
+}
+
 // Called in "init.cc" when a core is idle. Beware of stack overflow
 extern void event_loop();
 
+// a coroutine nobody waits for. it runs until it first blocks when called
+// and frees its frame when it finishes
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() noexcept {
+        }
+
+        void unhandled_exception() noexcept {
+        }
+    };
+};
+
 class co_delay {
     uint32_t const ms;
 public:
@@ -1,6 +1,7 @@
 #include "ext2.h"
 
 #include "libk.h"
+#include "rcu.h"
 
 // ====================================================
 // ====================== Node ========================
@@ -214,6 +215,89 @@ uint32_t Node::entry_count() {
     return num_entries;
 }
 
+// ====================================================
+// ===================== DirCache =====================
+// ====================================================
+
+DirCache::Entry::Entry(uint32_t dir, uint32_t hash, const char* name, Shared<Node> node) : dir(dir),
+                                                                                          hash(hash),
+                                                                                          node(node),
+                                                                                          name(new char[K::strlen(name) + 1]) {
+    memcpy(this->name, name, K::strlen(name) + 1);
+}
+
+DirCache::Entry::~Entry() {
+    delete[] name;
+}
+
+DirCache::~DirCache() {
+    for (uint32_t i = 0; i < BUCKETS; i++) {
+        while (buckets[i].first != nullptr) {
+            Entry* e = buckets[i].first;
+            buckets[i].first = e->next;
+            delete e;
+        }
+    }
+}
+
+uint32_t DirCache::hash(uint32_t dir, const char* name) {
+    // FNV-1a over the directory and the name
+    uint32_t h = 2166136261u ^ dir;
+    h *= 16777619u;
+    for (const char* p = name; *p != '\0'; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+Shared<Node> DirCache::find(uint32_t dir, const char* name, uint32_t hash) {
+    Bucket& b = buckets[hash % BUCKETS];
+    for (Entry* e = Rcu::read(b.first); e != nullptr; e = Rcu::read(e->next)) {
+        if (e->hash == hash && e->dir == dir && K::streq(e->name, name)) {
+            return e->node;
+        }
+    }
+    return Shared<Node>::NUL;
+}
+
+void DirCache::add(uint32_t dir, const char* name, uint32_t hash, Shared<Node> node) {
+    Bucket& b = buckets[hash % BUCKETS];
+    Entry* fresh = new Entry(dir, hash, name, node);
+    Entry* evicted = nullptr;
+
+    b.lock.lock();
+    for (Entry* e = b.first; e != nullptr; e = e->next) {
+        // someone else looked it up at the same time
+        if (e->hash == hash && e->dir == dir && K::streq(e->name, name)) {
+            b.lock.unlock();
+            delete fresh;
+            return;
+        }
+    }
+
+    fresh->next = b.first;
+    Rcu::publish(b.first, fresh);
+
+    // the oldest one is at the end
+    if (++b.count > WAYS) {
+        Entry** pprev = &b.first;
+        while ((*pprev)->next != nullptr) {
+            pprev = &(*pprev)->next;
+        }
+        evicted = *pprev;
+        Rcu::publish(*pprev, (Entry*)nullptr);
+        b.count--;
+    }
+    b.lock.unlock();
+
+    if (evicted != nullptr) {
+        Rcu::defer([evicted] {
+            delete evicted;
+        });
+    }
+}
+
 // ====================================================
 // ====================== Ext2 ========================
 // ====================================================
@@ -271,11 +355,19 @@ Shared<Node> Ext2::get_node(uint32_t inumber) {
 }
 
 Shared<Node> Ext2::find(Shared<Node> dir, const char* name) {
+    uint32_t hash = DirCache::hash(dir->number, name);
+    Shared<Node> node = dir_cache.find(dir->number, name, hash);
+    if (node != Shared<Node>::NUL) {
+        return node;
+    }
+
     uint32_t inumber = dir->find(name);
     if (inumber == 0) {
         return Shared<Node>::NUL;
     }
-    return get_node(inumber);
+    node = get_node(inumber);
+    dir_cache.add(dir->number, name, hash, node);
+    return node;
 }
 
 Shared<Node> Ext2::find_by_path(Shared<Node> from, const char* path) {
@@ -178,6 +178,45 @@ class Node : public BlockIO {  // we implement BlockIO because we
     }
 };
 
+// remembers the nodes that names in directories led to, so walking a path
+// doesn't have to search every directory again. lookups take no lock, an
+// entry pushed out of a full bucket is freed once no lookup can be on it
+class DirCache {
+    struct Entry {
+        uint32_t const dir;
+        uint32_t const hash;
+        Shared<Node> const node;
+        char* const name;
+        Entry* next = nullptr;
+
+        Entry(uint32_t dir, uint32_t hash, const char* name, Shared<Node> node);
+        ~Entry();
+    };
+
+    struct Bucket {
+        SpinLock lock{};  // writers only
+        Entry* first = nullptr;
+        uint32_t count = 0;
+    };
+
+    static constexpr uint32_t BUCKETS = 256;
+    static constexpr uint32_t WAYS = 4;
+    Bucket buckets[BUCKETS];
+
+   public:
+    DirCache() = default;
+    ~DirCache();
+
+    DirCache(const DirCache&) = delete;
+
+    static uint32_t hash(uint32_t dir, const char* name);
+
+    // the node name leads to in the directory, or null if we don't know
+    Shared<Node> find(uint32_t dir, const char* name, uint32_t hash);
+
+    void add(uint32_t dir, const char* name, uint32_t hash, Shared<Node> node);
+};
+
 // This class encapsulates the implementation of the Ext2 file system
 class Ext2 {
     // the superblock
@@ -190,6 +229,9 @@ class Ext2 {
     uint32_t block_group_count;
     Ext2_BlockGroupDesc* block_groups_descriptor_table;
 
+    // the file system is never written, so entries stay right for good
+    DirCache dir_cache;
+
    public:
     // The root directory for this file system
     Shared<Node> root;
@@ -6,10 +6,352 @@ extern TextUI::Render* TextUI::render;
 
 namespace UserFileIO {
 
+// +++ blocking transfers
+
+    // the most bytes a blocking transfer holds in the kernel at once
+    static constexpr uint32_t CHUNK = VMM::PAGE_SIZE;
+
+    /**
+     * resumes the coroutine with me's address space loaded, so it can get at me's memory.
+     * whoever resumed us may still need its own, so the switch happens in an event of its own
+     */
+    struct co_enter {
+        ProcessManagement::Process me;
+
+        bool await_ready() {
+            return ProcessManagement::Process::current() == me;
+        }
+
+        void await_suspend(std::coroutine_handle<void> handle) noexcept {
+            go([me = me, handle] {
+                ProcessManagement::Process::change(me);
+                handle.resume();
+            });
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    /**
+     * a place in a list of segments, moved along as bytes are copied in or out of them
+     */
+    struct SegCursor {
+        const IoVec* segs;
+        uint32_t seg = 0;
+        uint32_t at = 0;
+
+        explicit SegCursor(const IoVec* segs) : segs(segs) {}
+
+        // copies the next n bytes of the segments to chunk, or from chunk into them
+        void copy(char* chunk, uint32_t n, bool into_segs) {
+            while (n > 0) {
+                uint32_t part = K::min(n, segs[seg].len - at);
+                char* place = (char*)segs[seg].base + at;
+                if (into_segs) {
+                    memcpy(place, chunk, part);
+                } else {
+                    memcpy(chunk, place, part);
+                }
+                chunk += part;
+                n -= part;
+                at += part;
+                if (at == segs[seg].len) {
+                    seg++;
+                    at = 0;
+                }
+            }
+        }
+    };
+
+    static uint32_t total_len(const IoVec* iov, uint32_t count) {
+        uint32_t len = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            len += iov[i].len;
+        }
+        return len;
+    }
+
+    /**
+     * reads bytes from bb into the count segs in me's memory, a chunk at a time, then lets me go.
+     * the reading semaphore is held throughout so nothing else reads in between. segs is a
+     * kernel copy that this frees
+     */
+    static Task read_into(ProcessManagement::Process me, BoundedBuffer<char>& bb, IoVec* segs, uint32_t count) {
+        uint32_t len = total_len(segs, count);
+        char* got = new char[K::min(len, CHUNK)];
+        SegCursor to{segs};
+        co_await bb.reading;
+        for (uint32_t done = 0; done < len;) {
+            uint32_t n = K::min(len - done, CHUNK);
+            for (uint32_t i = 0; i < n; i++) {
+                got[i] = co_await bb.take();
+            }
+            co_await co_enter{me};
+            to.copy(got, n, true);
+            done += n;
+        }
+        bb.reading.up();
+        delete[] got;
+        delete[] segs;
+        me.schedule();
+    }
+
+    /**
+     * read_into for a single buffer
+     */
+    static void read_from(ProcessManagement::Process me, BoundedBuffer<char>& bb, uint32_t len, char* buffer) {
+        IoVec* segs = new IoVec[1];
+        segs[0].base = buffer;
+        segs[0].len = len;
+        read_into(me, bb, segs, 1);
+    }
+
+    /**
+     * writes the count segs in me's memory into bb, a chunk at a time, then lets me go.
+     * the writing semaphore is held throughout so the bytes go in as one write. segs is a
+     * kernel copy that this frees
+     */
+    static Task write_from(ProcessManagement::Process me, BoundedBuffer<char>& bb, IoVec* segs, uint32_t count) {
+        uint32_t len = total_len(segs, count);
+        char* data = new char[K::min(len, CHUNK)];
+        SegCursor from{segs};
+        co_await bb.writing;
+        for (uint32_t done = 0; done < len;) {
+            uint32_t n = K::min(len - done, CHUNK);
+            co_await co_enter{me};
+            from.copy(data, n, false);
+            for (uint32_t i = 0; i < n; i++) {
+                co_await bb.give(data[i]);
+            }
+            done += n;
+        }
+        bb.writing.up();
+        delete[] data;
+        delete[] segs;
+        me.schedule();
+    }
+
+    /**
+     * blocks the current process until all of iov has been read from bb
+     */
+    static int64_t blocking_readv(BoundedBuffer<char>& bb, const IoVec* iov, uint32_t count) {
+        using namespace ProcessManagement;
+
+        // iov is gone by the time the bytes are, keep our own
+        IoVec* segs = new IoVec[count];
+        memcpy(segs, (void*)iov, count * sizeof(IoVec));
+
+        PCB::current().regs.eax = total_len(iov, count);
+        block([&bb, segs, count](Process me) {
+            read_into(me, bb, segs, count);
+        });
+
+        // it should never return
+        return -2;
+    }
+
+    /**
+     * bytes a send picked up from the page cache. the frame stays put for as long as we hold it
+     */
+    struct PageRun {
+        SmartPMM::SmartPhysPage<char> page;
+        uint32_t start;
+        uint32_t len;
+
+        PageRun() : page(MM::PageNum::bad()), start(0), len(0) {}
+    };
+
+    // the most page cache frames one send holds on to, longer sends come back short
+    static constexpr uint32_t SEND_MAX_PAGES = 64;
+
+    /**
+     * picks up the bytes of node from at on as page cache frames, as many as runs has room for.
+     * returns how many bytes the count runs cover
+     */
+    static uint32_t gather_runs(Shared<Node> node, uint32_t at, uint32_t len, PageRun* runs, uint32_t& count) {
+        using namespace VMM;
+
+        uint32_t size = node->size_in_bytes();
+        uint32_t end = at >= size ? at : at + K::min(len, size - at);
+        uint32_t pos = at;
+
+        count = 0;
+        while (pos < end && count < SEND_MAX_PAGES) {
+            PageRun& run = runs[count++];
+            run.page = BadPageCache::get_ro_file_page(node, page_num(pos));
+            run.start = pos % PAGE_SIZE;
+            run.len = K::min(PAGE_SIZE - run.start, end - pos);
+            pos += run.len;
+        }
+        return pos - at;
+    }
+
+    /**
+     * gives the count runs to out straight from their frames, then frees them and lets me go
+     */
+    static Task give_runs(ProcessManagement::Process me, Shared<UserFileContainer> out, PageRun* runs, uint32_t count) {
+        BoundedBuffer<char>& bb = *out->ptr->write_stream();
+        co_await bb.writing;
+        for (uint32_t i = 0; i < count; i++) {
+            for (uint32_t j = 0; j < runs[i].len; j++) {
+                co_await bb.give(runs[i].page[runs[i].start + j]);
+            }
+        }
+        bb.writing.up();
+        delete[] runs;
+        me.schedule();
+    }
+
+    /**
+     * moves len bytes from one stream into out, then lets me go
+     */
+    static Task pump(ProcessManagement::Process me, BoundedBuffer<char>& from, Shared<UserFileContainer> out, uint32_t len) {
+        BoundedBuffer<char>* to = out->ptr->write_stream();
+        co_await from.reading;
+        if (to != nullptr) {
+            co_await to->writing;
+            for (uint32_t i = 0; i < len; i++) {
+                char c = co_await from.take();
+                co_await to->give(c);
+            }
+            to->writing.up();
+            from.reading.up();
+        } else {
+            // the terminals write right away, and don't care whose memory the bytes are in
+            char* got = new char[K::min(len, CHUNK)];
+            for (uint32_t done = 0; done < len;) {
+                uint32_t n = K::min(len - done, CHUNK);
+                for (uint32_t i = 0; i < n; i++) {
+                    got[i] = co_await from.take();
+                }
+                out->ptr->do_write(n, got);
+                done += n;
+            }
+            from.reading.up();
+            delete[] got;
+        }
+        me.schedule();
+    }
+
 // +++ UserFile
 
     UserFile::~UserFile() {}
 
+    int64_t UserFile::do_pread(uint32_t len, void* buffer, uint32_t offset) {
+        return -1;
+    }
+
+    int64_t UserFile::seek(int32_t offset, int whence) {
+        return -1;
+    }
+
+    int64_t UserFile::do_send(Shared<UserFileContainer> out, uint32_t len, uint32_t* offset) {
+        using namespace ProcessManagement;
+
+        BoundedBuffer<char>* from = read_stream();
+        if (from == nullptr || offset != nullptr) {
+            return -1;
+        }
+
+        PCB::current().regs.eax = len;
+        block([from, out, len](Process me) {
+            pump(me, *from, out, len);
+        });
+
+        // it should never return
+        return -2;
+    }
+
+    BoundedBuffer<char>* UserFile::read_stream() {
+        return nullptr;
+    }
+
+    BoundedBuffer<char>* UserFile::write_stream() {
+        return nullptr;
+    }
+
+    uint32_t UserFile::ready() {
+        BoundedBuffer<char>* from = read_stream();
+        BoundedBuffer<char>* to = write_stream();
+        uint32_t bits = 0;
+        if (from == nullptr || from->can_take()) {
+            bits |= POLLIN;
+        }
+        if (to == nullptr || to->can_give()) {
+            bits |= POLLOUT;
+        }
+        return bits;
+    }
+
+    // a pipe reads and writes the same buffer, it only needs watching once
+    void UserFile::watch(Watcher* w) {
+        BoundedBuffer<char>* from = read_stream();
+        BoundedBuffer<char>* to = write_stream();
+        if (from != nullptr) {
+            from->watchers.add(w);
+        }
+        if (to != nullptr && to != from) {
+            to->watchers.add(w);
+        }
+    }
+
+    void UserFile::unwatch(Watcher* w) {
+        BoundedBuffer<char>* from = read_stream();
+        BoundedBuffer<char>* to = write_stream();
+        if (from != nullptr) {
+            from->watchers.remove(w);
+        }
+        if (to != nullptr && to != from) {
+            to->watchers.remove(w);
+        }
+    }
+
+    int64_t UserFile::do_read_available(uint32_t len, void* buffer) {
+        BoundedBuffer<char>* from = read_stream();
+        if (from == nullptr) {
+            return do_read(len, buffer);
+        }
+
+        // what is there belongs to a blocked read that got in first
+        if (!from->reading.await_ready()) {
+            return 0;
+        }
+        char* to = (char*)buffer;
+        uint32_t n = 0;
+        while (n < len && from->try_take(to[n])) {
+            n++;
+        }
+        from->reading.up();
+        return n;
+    }
+
+    int64_t UserFile::do_readv(const IoVec* iov, uint32_t count) {
+        int64_t total = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t n = do_read(iov[i].len, iov[i].base);
+            if (n < 0) {
+                return total > 0 ? total : n;
+            }
+            total += n;
+            if (n < iov[i].len) break;
+        }
+        return total;
+    }
+
+    int64_t UserFile::do_writev(const IoVec* iov, uint32_t count) {
+        int64_t total = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t n = do_write(iov[i].len, iov[i].base);
+            if (n < 0) {
+                return total > 0 ? total : n;
+            }
+            total += n;
+            if (n < iov[i].len) break;
+        }
+        return total;
+    }
+
     int64_t UserFile::len() {
         return -1;
     }
@@ -20,6 +362,85 @@ namespace UserFileIO {
         delete ptr;
     }
 
+// +++ FileTable
+
+    void FileTable::copy_from(FileTable& from) {
+        LockGuard g{from.lock};
+        for (int fd = 0; fd < MAX_FDS; fd++) {
+            fds[fd] = from.fds[fd];
+        }
+    }
+
+    OpenFile FileTable::get(int fd) {
+        if (fd < 0 || fd >= MAX_FDS) {
+            return OpenFile();
+        }
+        LockGuard g{lock};
+        return fds[fd];
+    }
+
+    // the caller holds the lock
+    static int free_slot(FileTable& table, int after) {
+        for (int fd = K::max(0, after) + 1; fd < FileTable::MAX_FDS; fd++) {
+            if (table.fds[fd].uf == Shared<UserFileContainer>::NUL) {
+                return fd;
+            }
+        }
+        return -1;
+    }
+
+    int FileTable::add(OpenFile file, int after) {
+        LockGuard g{lock};
+        int fd = free_slot(*this, after);
+        if (fd != -1) {
+            fds[fd] = file;
+        }
+        return fd;
+    }
+
+    int FileTable::dup(int fd) {
+        if (fd < 0 || fd >= MAX_FDS) {
+            return -1;
+        }
+        LockGuard g{lock};
+        if (fds[fd].uf == Shared<UserFileContainer>::NUL) {
+            return -1;
+        }
+        int new_fd = free_slot(*this, -1);
+        if (new_fd != -1) {
+            fds[new_fd] = fds[fd];
+        }
+        return new_fd;
+    }
+
+    bool FileTable::close(int fd) {
+        if (fd < 0 || fd >= MAX_FDS) {
+            return false;
+        }
+
+        // the last reference may go with it, so drop it once the lock is let go
+        OpenFile closed{};
+        {
+            LockGuard g{lock};
+            closed = fds[fd];
+            fds[fd] = OpenFile();
+        }
+        return !(closed.uf == Shared<UserFileContainer>::NUL);
+    }
+
+    bool FileTable::set_perms(int fd, Flags perms, bool on) {
+        if (fd < 0 || fd >= MAX_FDS) {
+            return false;
+        }
+        LockGuard g{lock};
+        OpenFile& file = fds[fd];
+        if (file.uf == Shared<UserFileContainer>::NUL) {
+            return false;
+        }
+        file.perms = on ? file.perms | perms : file.perms - perms;
+        return true;
+    }
+
 // +++ OpenFile
 
     OpenFile::OpenFile() : OpenFile(Shared<UserFileContainer>::NUL, 0) {}
@@ -38,6 +459,9 @@ namespace UserFileIO {
         if (perms.is_not(Flags::USER_FILE_READ)) {
             return {-1};
         }
+        if (perms.is(Flags::USER_FILE_NONBLOCK)) {
+            return uf->ptr->do_read_available(len, buffer);
+        }
         return uf->ptr->do_read(len, buffer);
     }
 
@@ -48,6 +472,76 @@ namespace UserFileIO {
         return uf->ptr->do_write(len, buffer);
     }
 
+    int64_t OpenFile::pread(uint32_t len, void* buffer, uint32_t offset) {
+        if (perms.is_not(Flags::USER_FILE_READ)) {
+            return {-1};
+        }
+        return uf->ptr->do_pread(len, buffer, offset);
+    }
+
+    int64_t OpenFile::seek(int32_t offset, int whence) {
+        return uf->ptr->seek(offset, whence);
+    }
+
+    int64_t OpenFile::readv(const IoVec* iov, uint32_t count) {
+        if (perms.is_not(Flags::USER_FILE_READ)) {
+            return {-1};
+        }
+        if (perms.is(Flags::USER_FILE_NONBLOCK)) {
+            int64_t total = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                int64_t n = uf->ptr->do_read_available(iov[i].len, iov[i].base);
+                if (n < 0) {
+                    return total > 0 ? total : n;
+                }
+                total += n;
+                if (n < iov[i].len) break;
+            }
+            return total;
+        }
+        return uf->ptr->do_readv(iov, count);
+    }
+
+    int64_t OpenFile::writev(const IoVec* iov, uint32_t count) {
+        if (perms.is_not(Flags::USER_FILE_WRITE)) {
+            return {-1};
+        }
+        return uf->ptr->do_writev(iov, count);
+    }
+
+    int64_t OpenFile::send(OpenFile& out, uint32_t len, uint32_t* offset) {
+        if (perms.is_not(Flags::USER_FILE_READ) || out.perms.is_not(Flags::USER_FILE_WRITE)) {
+            return {-1};
+        }
+        // node files take no writes yet, and the offset would move for nothing
+        if (out.type() == NODE) {
+            return {-1};
+        }
+        if (len == 0) {
+            return 0;
+        }
+        return uf->ptr->do_send(out.uf, len, offset);
+    }
+
+    uint32_t OpenFile::ready() {
+        uint32_t bits = uf->ptr->ready();
+        if (perms.is_not(Flags::USER_FILE_READ)) {
+            bits &= ~POLLIN;
+        }
+        if (perms.is_not(Flags::USER_FILE_WRITE)) {
+            bits &= ~POLLOUT;
+        }
+        return bits;
+    }
+
+    void OpenFile::watch(Watcher* w) {
+        uf->ptr->watch(w);
+    }
+
+    void OpenFile::unwatch(Watcher* w) {
+        uf->ptr->unwatch(w);
+    }
+
 // +++ NodeFile
 
     NodeFile::NodeFile(Shared<Node> node) : guard(),
@@ -59,23 +553,47 @@ namespace UserFileIO {
         return NODE;
     }
 
-    int64_t NodeFile::do_read(uint32_t len, void* buffer) {
-        using namespace VMM;
+    uint32_t NodeFile::claim(uint32_t& len) {
+        LockGuard g{guard};
 
+        uint32_t size = node->size_in_bytes();
+        uint32_t at = offset;
+        len = at >= size ? 0 : K::min(len, size - at);
+        offset += len;
+        return at;
+    }
+
+    // a fault on the user's buffer kills us, so it is only written once the guard is dropped
+    int64_t NodeFile::do_read(uint32_t len, void* buffer) {
         if (node->is_dir()) {
             return {-1};
         }
 
-        LockGuard{guard};
-
-        // int64_t nbyte = BadPageCache::read_all(node, offset, len, buffer);
-        int64_t nbyte = node->read_all(offset, len, (char*)buffer);
+        uint32_t at = claim(len);
+        return node->read_all(at, len, (char*)buffer);
+    }
 
-        if (nbyte != -1) {
-            offset += nbyte;
+    // the whole vector is claimed at once, so it is read in one piece
+    int64_t NodeFile::do_readv(const IoVec* iov, uint32_t count) {
+        if (node->is_dir()) {
+            return {-1};
         }
 
-        return nbyte;
+        uint32_t len = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            len += iov[i].len;
+        }
+        uint32_t at = claim(len);
+
+        int64_t total = 0;
+        for (uint32_t i = 0; i < count && total < len; i++) {
+            int64_t nbyte = node->read_all(at + total, K::min(iov[i].len, len - (uint32_t)total), (char*)iov[i].base);
+            if (nbyte == -1) {
+                return total > 0 ? total : -1;
+            }
+            total += nbyte;
+        }
+        return total;
     }
 
     int64_t NodeFile::do_write(uint32_t len, void* buffer) {
@@ -91,6 +609,97 @@ namespace UserFileIO {
         return node->size_in_bytes();
     }
 
+    // nothing shared is touched, so readers of one file don't wait on each other
+    int64_t NodeFile::do_pread(uint32_t len, void* buffer, uint32_t offset) {
+        if (node->is_dir()) {
+            return {-1};
+        }
+
+        return node->read_all(offset, len, (char*)buffer);
+    }
+
+    int64_t NodeFile::seek(int32_t offset, int whence) {
+        if (node->is_dir()) {
+            return {-1};
+        }
+
+        LockGuard g{guard};
+
+        int64_t base;
+        switch (whence) {
+            case SEEK_SET:
+                base = 0;
+                break;
+            case SEEK_CUR:
+                base = this->offset;
+                break;
+            case SEEK_END:
+                base = node->size_in_bytes();
+                break;
+            default:
+                return -1;
+        }
+
+        // the new offset is what seek returns to the user, keep it positive
+        int64_t to = base + offset;
+        if (to < 0 || to > 0x7fffffff) {
+            return -1;
+        }
+        this->offset = (uint32_t)to;
+        return to;
+    }
+
+    // the bytes go from page cache frames to out, without a buffer of ours in between
+    int64_t NodeFile::do_send(Shared<UserFileContainer> out, uint32_t len, uint32_t* offset) {
+        using namespace ProcessManagement;
+
+        if (node->is_dir()) {
+            return {-1};
+        }
+
+        PageRun* runs = new PageRun[SEND_MAX_PAGES];
+        uint32_t count;
+        uint32_t total;
+
+        // a given offset is the caller's own, only the shared one needs the guard
+        if (offset != nullptr) {
+            uint32_t at = *offset;
+            total = gather_runs(node, at, len, runs, count);
+            *offset = at + total;
+        } else {
+            LockGuard g{guard};
+            total = gather_runs(node, this->offset, len, runs, count);
+            this->offset += total;
+        }
+
+        if (total == 0) {
+            delete[] runs;
+            return 0;
+        }
+
+        if (out->ptr->write_stream() != nullptr) {
+            PCB::current().regs.eax = total;
+            block([out, runs, count](Process me) {
+                give_runs(me, out, runs, count);
+            });
+
+            // it should never return
+            return -2;
+        }
+
+        int64_t written = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t n = out->ptr->do_write(runs[i].len, (char*)runs[i].page.address() + runs[i].start);
+            if (n < 0) {
+                written = written > 0 ? written : n;
+                break;
+            }
+            written += n;
+        }
+        delete[] runs;
+        return written;
+    }
+
 // +++ TerminalFile
     TerminalFile::TerminalFile() : bb((unsigned)-1) {}
     TerminalFile::~TerminalFile() {}
@@ -102,31 +711,24 @@ namespace UserFileIO {
     int64_t TerminalFile::do_read(uint32_t len, void* buffer) {
         using namespace ProcessManagement;
 
-        /**
-         * create the trigger... we need one extra spots
-         * we need one for each byte to read and one for the trigger
-         */
-        Shared<Barrier> trigger = Shared<Barrier>::make(len + 1);
-
-        for (uint32_t i = 0; i < len; i++) {
-            char* place = ((char*)buffer) + i;
-            bb.get([trigger, place, me = Process::current()](char c) {
-                // FIXME : this is horibbly slow... we should either write a custom BB or buffer the contents
-                Process old = Process::change(me);
-                *place = c;
-                Process::change(old);
-                trigger->sync();
-            });
-        }
-
         PCB::current().regs.eax = len;
-        block_and_sync(trigger);
+        block([this, len, buffer](Process me) {
+            read_from(me, bb, len, (char*)buffer);
+        });
 
         // let's return -2 here so we can see a sign if something is wrong
         // it should never return
         return -2;
     }
 
+    int64_t TerminalFile::do_readv(const IoVec* iov, uint32_t count) {
+        return blocking_readv(bb, iov, count);
+    }
+
+    BoundedBuffer<char>* TerminalFile::read_stream() {
+        return &bb;
+    }
+
     int64_t TerminalFile::do_write(uint32_t len, void* buffer) {
         char* bytes = (char*)buffer;
         for (uint32_t i = 0; i < len; i++) {
@@ -150,31 +752,24 @@ namespace UserFileIO {
 
     int64_t TUIFile::do_read(uint32_t len, void* buffer) { // Reads from this file to the buffer
         using namespace ProcessManagement;
-        /**
-         * create the trigger... we need one extra spots
-         * we need one for each byte to read and one for the trigger
-         */
-        Shared<Barrier> trigger = Shared<Barrier>::make(len + 1);
-
-        for (uint32_t i = 0; i < len; i++) {
-            char* place = ((char*)buffer) + i;
-            data_bb.get([trigger, place, me = Process::current()](char c) {
-                // FIXME : this is horibbly slow... we should either write a custom BB or buffer the contents
-                Process old = Process::change(me);
-                *place = c;
-                Process::change(old);
-                trigger->sync();
-            });
-        }
-
         PCB::current().regs.eax = len;
-        block_and_sync(trigger);
+        block([this, len, buffer](Process me) {
+            read_from(me, data_bb, len, (char*)buffer);
+        });
 
         // let's return -2 here so we can see a sign if something is wrong
         // it should never return
         return -2;
     }
 
+    int64_t TUIFile::do_readv(const IoVec* iov, uint32_t count) {
+        return blocking_readv(data_bb, iov, count);
+    }
+
+    BoundedBuffer<char>* TUIFile::read_stream() {
+        return &data_bb;
+    }
+
     int64_t TUIFile::do_write(uint32_t len, void* buffer) { // Writes from buffer to the TUIFile
         using namespace TextUI;
         char* bytes = (char*)buffer;
@@ -197,25 +792,10 @@ namespace UserFileIO {
     int64_t PipeFile::do_read(uint32_t len, void* buffer) {
         using namespace ProcessManagement;
 
-        /**
-         * create the trigger... we need one extra spots
-         * we need one for each byte to read and one for the trigger
-         */
-        Shared<Barrier> trigger = Shared<Barrier>::make(len + 1);
-
-        for (uint32_t i = 0; i < len; i++) {
-            char* place = ((char*)buffer) + i;
-            bb.get([trigger, place, me = Process::current()](char c) {
-                // FIXME : this is horibbly slow... we should either write a custom BB or buffer the contents
-                Process old = Process::change(me);
-                *place = c;
-                Process::change(old);
-                trigger->sync();
-            });
-        }
-
         PCB::current().regs.eax = len;
-        block_and_sync(trigger);
+        block([this, len, buffer](Process me) {
+            read_from(me, bb, len, (char*)buffer);
+        });
 
         // let's return -2 here so we can see a sign if something is wrong
         // it should never return
@@ -225,27 +805,49 @@ namespace UserFileIO {
     int64_t PipeFile::do_write(uint32_t len, void* buffer) {
         using namespace ProcessManagement;
 
-        /**
-         * create the trigger... we need one extra spots
-         * we need one for each byte to write and one for the trigger
-         */
-        Shared<Barrier> trigger = Shared<Barrier>::make(len + 1);
-
-        for (uint32_t i = 0; i < len; i++) {
-            char* place = ((char*)buffer) + i;
-            bb.put(*place, [trigger]() {
-                trigger->sync();
-            });
-        }
+        IoVec* segs = new IoVec[1];
+        segs[0].base = buffer;
+        segs[0].len = len;
 
         PCB::current().regs.eax = len;
-        block_and_sync(trigger);
+        block([this, segs](Process me) {
+            write_from(me, bb, segs, 1);
+        });
 
         // let's return -2 here so we can see a sign if something is wrong
-        // it should never retur
+        // it should never return
         return -2;
     }
 
+    int64_t PipeFile::do_readv(const IoVec* iov, uint32_t count) {
+        return blocking_readv(bb, iov, count);
+    }
+
+    int64_t PipeFile::do_writev(const IoVec* iov, uint32_t count) {
+        using namespace ProcessManagement;
+
+        // iov is gone by the time the bytes are in, keep our own.
+        // the writing semaphore is held across all of them, the pipe sees a single write
+        IoVec* segs = new IoVec[count];
+        memcpy(segs, (void*)iov, count * sizeof(IoVec));
+
+        PCB::current().regs.eax = total_len(iov, count);
+        block([this, segs, count](Process me) {
+            write_from(me, bb, segs, count);
+        });
+
+        // it should never return
+        return -2;
+    }
+
+    BoundedBuffer<char>* PipeFile::read_stream() {
+        return &bb;
+    }
+
+    BoundedBuffer<char>* PipeFile::write_stream() {
+        return &bb;
+    }
+
 
 
 // globals
@@ -265,7 +867,7 @@ namespace UserFileIO {
     OpenFile get_active_tui() {
         using namespace ProcessManagement;
         //Debug::printf("The active tui is: %d\n", PCB::current().active_tui);
-        return PCB::current().user_files[PCB::current().active_tui];
+        return PCB::current().files->get(PCB::current().active_tui);
     }
 
 }
@@ -274,7 +876,7 @@ namespace UserFileIO {
 // OpenFile get_active_tui() {
 //     using namespace ProcessManagement;
     
-//     return PCB::current().user_files[PCB::current().active_tui];
+//     return PCB::current().files->fds[PCB::current().active_tui];
 // }  
 
 // namespace UserFileIO
\ No newline at end of file
@@ -1,13 +1,13 @@
 #pragma once
 
 #include "atomic.h"
-#include "barrier.h"
 #include "bb.h"
 #include "filesystem.h"
 #include "flags.h"
 #include "shared.h"
 #include "stdint.h"
 #include "texteditor.h"
+#include "watch.h"
 
 /**
  * a namespace inteded for user by user processes as they can block
@@ -24,9 +24,24 @@ enum UserFileType {
     TUI = 3
 };
 
+// what poll asks about and answers with, the same bits as the user's
+constexpr uint32_t POLLIN = 0x1;
+constexpr uint32_t POLLOUT = 0x4;
+constexpr uint32_t POLLNVAL = 0x20;
+
+/**
+ * one segment of a vectored read or write, laid out like the user's struct iovec
+ */
+struct IoVec {
+    void* base;
+    uint32_t len;
+};
+
 /**
  * the interface provided by a userfile
  */
+struct UserFileContainer;
+
 struct UserFile {
     virtual ~UserFile();
 
@@ -40,6 +55,17 @@ struct UserFile {
      */
     virtual int64_t do_write(uint32_t len, void* buffer) = 0;
 
+    /**
+     * reads into the count segments in order. iov is only good until this returns or blocks.
+     * the default does a do_read per segment, files whose reads block have to override it
+     */
+    virtual int64_t do_readv(const IoVec* iov, uint32_t count);
+
+    /**
+     * writes the count segments in order, the default does a do_write per segment
+     */
+    virtual int64_t do_writev(const IoVec* iov, uint32_t count);
+
     /**
      * returns the type of this file
      */
@@ -49,8 +75,59 @@ struct UserFile {
      * returns the length of this file
      */
     virtual int64_t len();
+
+    /**
+     * reads len bytes at offset without using or moving the file's own offset.
+     * -1 for files that have no offsets
+     */
+    virtual int64_t do_pread(uint32_t len, void* buffer, uint32_t offset);
+
+    /**
+     * moves the file's offset like lseek and returns where it ended up.
+     * -1 for files that have no offsets
+     */
+    virtual int64_t seek(int32_t offset, int whence);
+
+    /**
+     * moves up to len bytes from this file into out without them passing through user memory.
+     * starts at *offset and moves it when offset is given, otherwise at the file's own offset.
+     * the default pumps read_stream, so it only works for files without offsets
+     */
+    virtual int64_t do_send(Shared<UserFileContainer> out, uint32_t len, uint32_t* offset);
+
+    /**
+     * the buffer reads take from, null for files that aren't a stream of bytes
+     */
+    virtual BoundedBuffer<char>* read_stream();
+
+    /**
+     * the buffer writes give to, null for files whose writes finish right away
+     */
+    virtual BoundedBuffer<char>* write_stream();
+
+    /**
+     * which of POLLIN and POLLOUT would go through right now without blocking.
+     * the default asks the streams, a file without one is always ready that way
+     */
+    virtual uint32_t ready();
+
+    /**
+     * starts or stops telling w whenever what ready says may have changed
+     */
+    virtual void watch(Watcher* w);
+    virtual void unwatch(Watcher* w);
+
+    /**
+     * reads whatever is there now, up to len bytes, without blocking.
+     * the default takes from read_stream, files without one read as usual
+     */
+    virtual int64_t do_read_available(uint32_t len, void* buffer);
 };
 
+constexpr int SEEK_SET = 0;
+constexpr int SEEK_CUR = 1;
+constexpr int SEEK_END = 2;
+
 struct UserFileContainer {
     UserFile* ptr;
 
@@ -83,7 +160,8 @@ struct OpenFile {
     int64_t len();
 
     /**
-     * checks permissions and reads len bytes into the buffer from this file at offset
+     * checks permissions and reads len bytes into the buffer from this file at offset.
+     * with USER_FILE_NONBLOCK it only reads what is already there
      */
     int64_t read(uint32_t len, void* buffer);
 
@@ -91,12 +169,95 @@ struct OpenFile {
      * checks permissions and writes len bytes from the buffer to this file at offset
      */
     int64_t write(uint32_t len, void* buffer);
+
+    /**
+     * checks permissions and reads into the count segments of iov
+     */
+    int64_t readv(const IoVec* iov, uint32_t count);
+
+    /**
+     * checks permissions and writes the count segments of iov
+     */
+    int64_t writev(const IoVec* iov, uint32_t count);
+
+    /**
+     * checks permissions and reads len bytes at offset
+     */
+    int64_t pread(uint32_t len, void* buffer, uint32_t offset);
+
+    /**
+     * moves the offset shared by everyone who has this file open
+     */
+    int64_t seek(int32_t offset, int whence);
+
+    /**
+     * checks permissions on both ends and sends up to len bytes from this file into out
+     */
+    int64_t send(OpenFile& out, uint32_t len, uint32_t* offset);
+
+    /**
+     * what the file is ready for, less what this end of it isn't allowed to do
+     */
+    uint32_t ready();
+
+    void watch(Watcher* w);
+    void unwatch(Watcher* w);
+};
+
+/**
+ * the open files of a process, its threads share one. threads on other cores open
+ * and close in it at the same time, so the slots are only touched under the lock
+ */
+struct FileTable {
+    static constexpr int MAX_FDS = 10;
+
+    SpinLock lock{};
+    OpenFile fds[MAX_FDS];
+
+    FileTable() {}
+    FileTable(const FileTable&) = delete;
+
+    /**
+     * takes a copy of every open file in from, for a fork
+     */
+    void copy_from(FileTable& from);
+
+    /**
+     * a copy of the open file at fd, it stays open for as long as the copy is held.
+     * the copy has no uf if fd is not open
+     */
+    OpenFile get(int fd);
+
+    /**
+     * puts file in the first free slot above after, returns it or -1 if there is none
+     */
+    int add(OpenFile file, int after = -1);
+
+    /**
+     * opens another descriptor for what fd has open, -1 if fd is not open or there is no room
+     */
+    int dup(int fd);
+
+    /**
+     * closes fd, false if it was not open
+     */
+    bool close(int fd);
+
+    /**
+     * turns perms on or off for fd alone, false if it is not open
+     */
+    bool set_perms(int fd, Flags perms, bool on);
 };
 
 class NodeFile : public UserFile {
+    // only the shared offset needs it, preads go around
     SpinLock guard;
     uint32_t offset;
 
+    // moves the shared offset past the next len bytes, cut to what the file has left,
+    // and returns where they start. the bytes get read after the guard is dropped
+    uint32_t claim(uint32_t& len);
+
    public:
     Shared<Node> node;
 
@@ -106,7 +267,11 @@ class NodeFile : public UserFile {
     virtual UserFileType type() override;
     virtual int64_t do_read(uint32_t len, void* buffer) override;
     virtual int64_t do_write(uint32_t len, void* buffer) override;
+    virtual int64_t do_readv(const IoVec* iov, uint32_t count) override;
     virtual int64_t len() override;
+    virtual int64_t do_pread(uint32_t len, void* buffer, uint32_t offset) override;
+    virtual int64_t seek(int32_t offset, int whence) override;
+    virtual int64_t do_send(Shared<UserFileContainer> out, uint32_t len, uint32_t* offset) override;
 };
 
 struct TerminalFile : public UserFile {
@@ -118,6 +283,8 @@ struct TerminalFile : public UserFile {
     virtual UserFileType type() override;
     virtual int64_t do_read(uint32_t len, void* buffer) override;
     virtual int64_t do_write(uint32_t len, void* buffer) override;
+    virtual int64_t do_readv(const IoVec* iov, uint32_t count) override;
+    virtual BoundedBuffer<char>* read_stream() override;
 };
 
 class PipeFile : public UserFile {
@@ -130,6 +297,10 @@ class PipeFile : public UserFile {
     virtual UserFileType type() override;
     virtual int64_t do_read(uint32_t len, void* buffer) override;
     virtual int64_t do_write(uint32_t len, void* buffer) override;
+    virtual int64_t do_readv(const IoVec* iov, uint32_t count) override;
+    virtual int64_t do_writev(const IoVec* iov, uint32_t count) override;
+    virtual BoundedBuffer<char>* read_stream() override;
+    virtual BoundedBuffer<char>* write_stream() override;
 };
 
     class TUIFile : public UserFile {
@@ -145,6 +316,8 @@ class PipeFile : public UserFile {
         virtual UserFileType type() override;
         virtual int64_t do_read(uint32_t len, void* buffer) override;
         virtual int64_t do_write(uint32_t len, void* buffer) override;
+        virtual int64_t do_readv(const IoVec* iov, uint32_t count) override;
+        virtual BoundedBuffer<char>* read_stream() override;
     };
 
     extern Shared<UserFileContainer> terminal;
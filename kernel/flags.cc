@@ -15,4 +15,5 @@ const Flags Flags::MMAP_F_UNALGN = Flags(0x20);
 const Flags Flags::MMAP_F_TRUNC = Flags(0x40);
 
 const Flags Flags::USER_FILE_READ = Flags(0x1);
-const Flags Flags::USER_FILE_WRITE = Flags(0x2);
\ No newline at end of file
+const Flags Flags::USER_FILE_WRITE = Flags(0x2);
+const Flags Flags::USER_FILE_NONBLOCK = Flags(0x4);
\ No newline at end of file
@@ -23,6 +23,7 @@ class Flags {
 
     static const Flags USER_FILE_READ;
     static const Flags USER_FILE_WRITE;
+    static const Flags USER_FILE_NONBLOCK;  // do reads take what is there instead of waiting
 
     inline Flags(uint32_t bits);
 
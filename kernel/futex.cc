@@ -0,0 +1,75 @@
+#include "futex.h"
+
+using namespace impl;
+
+Futex::Bucket Futex::buckets[Futex::BUCKETS]{};
+
+void Futex::add(Bucket& b, Waiter* w) {
+    Waiter** pprev = &b.first;
+    while (*pprev != nullptr) {
+        pprev = &(*pprev)->next;
+    }
+    *pprev = w;
+}
+
+int Futex::wake(uint32_t key, int n) {
+    Bucket& b = bucket_for(key);
+    Waiter* woken = nullptr;
+    Waiter** woken_tail = &woken;
+    int count = 0;
+
+    b.lock.lock();
+    Waiter** pprev = &b.first;
+    while (*pprev != nullptr && count < n) {
+        Waiter* w = *pprev;
+        if (w->key == key) {
+            *pprev = w->next;
+            w->next = nullptr;
+            *woken_tail = w;
+            woken_tail = &w->next;
+            count++;
+        } else {
+            pprev = &w->next;
+        }
+    }
+    b.lock.unlock();
+
+    while (woken != nullptr) {
+        Waiter* w = woken;
+        woken = w->next;
+        make_ready(w->e);
+        delete w;
+    }
+    return count;
+}
+
+int Futex::cancel(void const* owner) {
+    int count = 0;
+    for (uint32_t i = 0; i < BUCKETS; i++) {
+        Bucket& b = buckets[i];
+        Waiter* woken = nullptr;
+
+        b.lock.lock();
+        Waiter** pprev = &b.first;
+        while (*pprev != nullptr) {
+            Waiter* w = *pprev;
+            if (w->owner == owner) {
+                *pprev = w->next;
+                w->next = woken;
+                woken = w;
+                count++;
+            } else {
+                pprev = &w->next;
+            }
+        }
+        b.lock.unlock();
+
+        while (woken != nullptr) {
+            Waiter* w = woken;
+            woken = w->next;
+            make_ready(w->e);
+            delete w;
+        }
+    }
+    return count;
+}
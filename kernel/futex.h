@@ -0,0 +1,55 @@
+#pragma once
+
+#include "stdint.h"
+#include "atomic.h"
+#include "events.h"
+
+// waiters on user words, keyed by the physical address of the word so
+// processes sharing a page (VA_USER_SHARED, shared mmaps) find each other
+class Futex {
+    struct Waiter {
+        uint32_t const key;
+        impl::Event* const e;
+        void const* const owner;
+        Waiter* next = nullptr;
+        Waiter(uint32_t const key, impl::Event* e, void const* owner) : key(key), e(e), owner(owner) {}
+    };
+
+    struct Bucket {
+        SpinLock lock{};
+        Waiter* first = nullptr;
+    };
+
+    static constexpr uint32_t BUCKETS = 64;
+    static Bucket buckets[BUCKETS];
+
+    static Bucket& bucket_for(uint32_t key) {
+        return buckets[(key >> 2) % BUCKETS];
+    }
+
+    static void add(Bucket& b, Waiter* w);
+
+public:
+    // runs the work once woken if the word at the physical address key still holds
+    // expected, otherwise returns false and drops the work.
+    // checking and queueing happen under the bucket lock so a wake in between can't be lost.
+    // owner tags the waiter for cancel
+    template <typename Work>
+    static bool wait(uint32_t key, int expected, Work&& work, void const* owner = nullptr) {
+        Bucket& b = bucket_for(key);
+        b.lock.lock();
+        if (*(volatile int*)key != expected) {
+            b.lock.unlock();
+            return false;
+        }
+        add(b, new Waiter(key, impl::make_event(static_cast<Work&&>(work)), owner));
+        b.lock.unlock();
+        return true;
+    }
+
+    // wakes up to n waiters on the key in the order they came, returns how many
+    static int wake(uint32_t key, int n);
+
+    // wakes every waiter the owner queued, whatever its key, returns how many
+    static int cancel(void const* owner);
+};
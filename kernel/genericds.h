@@ -1,6 +1,7 @@
 #pragma once
 
 #include "atomic.h"
+#include "rcu.h"
 #include "shared.h"
 
 namespace Generic {
@@ -222,7 +223,7 @@ class FixedHashMap {
             FixedHashMapEntry* entry = new FixedHashMapEntry(key, val);
             num_items++;
             entry->next = buckets[bucket_idx];
-            buckets[bucket_idx] = entry;
+            Rcu::publish(buckets[bucket_idx], entry);
         } else {
             FixedHashMapEntry*& entry = fmpe_prev == nullptr ? buckets[bucket_idx] : fmpe_prev->next;
             entry->val = val;
@@ -243,6 +244,19 @@ class FixedHashMap {
         }
     }
 
+    /**
+     * get without the lock, for a map that is only ever put into with new keys.
+     * put publishes an entry once it is filled in and nothing is unlinked, so a
+     * reader sees each chain whole. a miss may be a put still on its way
+     */
+    V read(K key) {
+        FixedHashMapEntry* curr = Rcu::read(buckets[get_bucket_idx(key)]);
+        while (curr != nullptr && !EqualFunction<K>()(curr->key, key)) {
+            curr = curr->next;
+        }
+        return curr == nullptr ? null_value : curr->val;
+    }
+
     V remove(K key) {
         uint32_t bucket_idx = get_bucket_idx(key);
         LockGuard{bucket_guard[bucket_idx]};
@@ -14,7 +14,7 @@ static int *array;
 static int len;
 static int safe = 0;
 static int avail = 0;
-static SpinLock *theLock = nullptr;
+static ProfiledLock *theLock = nullptr;
 
 void makeTaken(int i, int ints);
 void makeAvail(int i, int ints);
@@ -135,7 +135,7 @@ void heapInit(void* base, size_t bytes) {
     makeTaken(0,2);
     makeAvail(2,len-4);
     makeTaken(len-2,2);
-    theLock = new SpinLock();
+    theLock = new ProfiledLock("heap");
 }
 
 void* malloc(size_t bytes) {
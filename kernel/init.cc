@@ -31,7 +31,8 @@ PerCPU<KernelRuntimeStack> stacks;
 static bool smpInitDone = false;
 
 extern "C" uint32_t pickKernelStack(void) {
-    return (uint32_t)&stacks.forCPU(smpInitDone ? SMP::me() : 0).bytes[KernelRuntimeStack::BYTES];
+    // APs get here before their %gs is set up
+    return (uint32_t)&stacks.forCPU(smpInitDone ? SMP::lapic_id() : 0).bytes[KernelRuntimeStack::BYTES];
 }
 
 // using namespace WindowManagement;
@@ -40,11 +41,46 @@ extern "C" uint32_t pickKernelStack(void) {
 static Atomic<uint32_t> howManyAreHere(0);
 
 bool onHypervisor = true;
+bool hasMwait = false;
+bool hasSysenter = false;
 
 static constexpr uint32_t HEAP_START = 1 * 1024 * 1024;
 static constexpr uint32_t HEAP_SIZE = 5 * 1024 * 1024;
 static constexpr uint32_t VMM_FRAMES = HEAP_START + HEAP_SIZE;
 
+// where boot time goes, printed once every core is in
+struct BootPhase {
+    const char* name;
+    uint64_t tsc;
+};
+
+static BootPhase bootPhases[16];
+static uint32_t bootPhaseCount = 0;
+
+// one core at a time records phases: the bootstrap core until it has
+// started the others, then whichever core comes in last
+static void bootPhase(const char* name) {
+    if (bootPhaseCount < sizeof(bootPhases) / sizeof(bootPhases[0])) {
+        bootPhases[bootPhaseCount++] = {name, rdtsc()};
+    }
+}
+
+static void printBootPhases() {
+    for (uint32_t i = 1; i < bootPhaseCount; i++) {
+        auto took = Pit::cycles_to_nanos(bootPhases[i].tsc - bootPhases[i - 1].tsc);
+        Debug::printf("| boot %s %uus\n", bootPhases[i].name, (uint32_t)took / 1000);
+    }
+    auto total = Pit::cycles_to_nanos(bootPhases[bootPhaseCount - 1].tsc - bootPhases[0].tsc);
+    Debug::printf("| boot total %uus\n", (uint32_t)total / 1000);
+}
+
+static void spinMicros(uint32_t us) {
+    uint64_t until = Pit::nanos() + us * 1000;
+    while (Pit::nanos() < until) {
+        pause();
+    }
+}
+
 
 extern "C" void kernelInit(void) {
     Debug::printf("This makes it hhere\n");
@@ -52,6 +88,7 @@ extern "C" void kernelInit(void) {
     //Debug::printf("THe current key: %c\n", uart.get());
 
     if (!smpInitDone) {
+        bootPhase("start");
         Debug::init(&uart);
         Debug::debugAll = false;
         Debug::printf("\n| What just happened? Why am I here?\n");
@@ -79,6 +116,11 @@ extern "C" void kernelInit(void) {
             }
             if (out.c & 0x8) {
                 Debug::printf("|     has MONITOR/MWAIT\n");
+                hasMwait = true;
+            }
+            if (out.d & 0x800) {
+                Debug::printf("|     has SYSENTER/SYSEXIT\n");
+                hasSysenter = true;
             }
             if (out.c & 0x80000000) {
                 onHypervisor = true;
@@ -100,6 +142,7 @@ extern "C" void kernelInit(void) {
 
         /* initialize the heap */
         heapInit((void*)HEAP_START, HEAP_SIZE);
+        bootPhase("heap");
 
         /* switch to dynamically allocated UART */
         U8250* uart = new U8250; 
@@ -111,6 +154,7 @@ extern "C" void kernelInit(void) {
 
         /* initialize the filesystem*/
         FileSystem::init(1);
+        bootPhase("filesystem");
 
         /* initialize physmem */
         PhysMem::init(VMM_FRAMES, kConfig.memSize - VMM_FRAMES);
@@ -120,6 +164,7 @@ extern "C" void kernelInit(void) {
 
         /* initlaize the kernel process */
         ProcessManagement::global_init();
+        bootPhase("memory");
 
         /* initialize the text ui renderer */
         TextUI::init();
@@ -135,7 +180,9 @@ extern "C" void kernelInit(void) {
 
         /* initialize IDT */
         IDT::init();
+        bootPhase("interrupts");
         Pit::calibrate(1000);
+        bootPhase("calibrate");
 
         SMP::running.fetch_add(1);
 
@@ -143,15 +190,25 @@ extern "C" void kernelInit(void) {
         //     - divisible by 4K (required by LAPIC)
         //     - PPN must fit in 8 bits (required by LAPIC)
         //     - consistent with mbr.S
+        //
+        // INIT-SIPI-SIPI to everyone before waiting for anyone, the APs
+        // come up together. One IPI per core rather than the all-but-self
+        // shorthand so cores past totalProcs stay asleep
+        Debug::printf("| starting %d cores at eip:0x%x\n", kConfig.totalProcs - 1, resetEIP);
         for (uint32_t id = 1; id < kConfig.totalProcs; id++) {
-            Debug::printf("| initialize %d\n", id);
             SMP::ipi(id, 0x4500);
-            Debug::printf("| reset %d\n", id);
-            Debug::printf("|      eip:0x%x\n", resetEIP);
-            SMP::ipi(id, 0x4600 | (((uintptr_t)resetEIP) >> 12));
-            while (SMP::running <= id)
-                ;
         }
+        spinMicros(10000);
+        for (int sipi = 0; sipi < 2; sipi++) {
+            for (uint32_t id = 1; id < kConfig.totalProcs; id++) {
+                SMP::ipi(id, 0x4600 | (((uintptr_t)resetEIP) >> 12));
+            }
+            spinMicros(200);
+        }
+        while (SMP::running < kConfig.totalProcs) {
+            pause();
+        }
+        bootPhase("start cores");
     } else {
         SMP::running.fetch_add(1);
         SMP::init(false);
@@ -175,11 +232,20 @@ extern "C" void kernelInit(void) {
     ltr(tssDescriptorBase + id * 8);
     tss[id].esp0 = pickKernelStack();
 
+    if (hasSysenter) {
+        // the fast system call entry, it starts on the same stack as int $48
+        wrmsr(IA32_SYSENTER_CS, kernelCS);
+        wrmsr(IA32_SYSENTER_ESP, tss[id].esp0);
+        wrmsr(IA32_SYSENTER_EIP, (uint32_t)sysenterHandler_);
+    }
+
     Debug::printf("| %d enabling interrupts, I'm scared\n", id);
     sti();
 
     auto myOrder = howManyAreHere.add_fetch(1);
     if (myOrder == kConfig.totalProcs) {
+        bootPhase("per core init");
+        printBootPhases();
         auto f = kernelMain();
         f.get([](int v) {
             Debug::shutdown();
@@ -9,5 +9,7 @@ extern "C" void graphicsInit(void);
 extern "C" void windowInit(void);
 
 extern bool onHypervisor;
+extern bool hasMwait;
+extern bool hasSysenter;
 
 #endif
@@ -35,9 +35,9 @@ Future<int> kernelMain(void) {
     Process::change(init_process);
 
     PCB::current().working_directory = FileSystem::get_root();
-    PCB::current().user_files[0] = stdin;
-    PCB::current().user_files[1] = stdout;
-    PCB::current().user_files[2] = stderr;
+    PCB::current().files->fds[0] = stdin;
+    PCB::current().files->fds[1] = stdout;
+    PCB::current().files->fds[2] = stderr;
 
     char* program_path = new char[sizeof(INIT_PROGRAM_PATH)];
     memcpy(program_path, INIT_PROGRAM_PATH, sizeof(INIT_PROGRAM_PATH));
@@ -21,6 +21,8 @@ extern "C" void invlpg(uint32_t va);
 extern "C" void apitHandler_(void);
 extern "C" void keyboard_interrupt_handler_(void);
 extern "C" void spuriousHandler_(void);
+extern "C" void wakeHandler_(void);
+extern "C" void tlbHandler_(void);
 extern "C" void pageFaultHandler_(void);
 
 extern "C" void* memcpy(void *dest, const void* src, size_t n);
@@ -28,6 +30,8 @@ extern "C" void* bzero(void *dest, size_t n);
 
 extern "C" void sti();
 extern "C" void cli();
+extern "C" void sti_hlt();
+extern "C" void sti_mwait();
 extern "C" uint32_t getCR3();
 extern "C" uint32_t getFlags();
 extern "C" void monitor(uintptr_t);
@@ -42,8 +46,22 @@ struct cpuid_out {
 
 extern "C" void cpuid(uint32_t eax, cpuid_out* out);
 
-//extern bool disable();
-//extern void enable(bool wasDisabled);
+inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// disables interrupts, returns whether they were already disabled
+inline bool disable() {
+    bool wasDisabled = (getFlags() & 0x200) == 0;
+    cli();
+    return wasDisabled;
+}
+
+inline void enable(bool wasDisabled) {
+    if (!wasDisabled) sti();
+}
 
 extern void pause();
 
@@ -55,11 +73,19 @@ extern uint32_t kernelCS;
 extern "C" void switchToUser(uint32_t pc, uint32_t esp, uint32_t eax);
 
 extern "C" void ltr(uint32_t);
+extern "C" void load_gs(uint32_t);
 
 extern uint32_t tssDescriptorBase;
+extern uint32_t cpuLocalDescriptorBase;
+extern "C" uint64_t cpuLocalDescriptors[];
 extern uint32_t kernelSS;
 
 extern "C" void sysHandler_(void);
+extern "C" void sysenterHandler_(void);
+
+constexpr uint32_t IA32_SYSENTER_CS = 0x174;
+constexpr uint32_t IA32_SYSENTER_ESP = 0x175;
+constexpr uint32_t IA32_SYSENTER_EIP = 0x176;
 
 
 #endif
@@ -6,7 +6,7 @@
 
 namespace PhysMem {
 
-    static SpinLock lock{};
+    static ProfiledLock lock{"frames"};
 
     struct Frame {
         Frame* next;
@@ -49,6 +49,16 @@ namespace PhysMem {
         firstFree = f;
     }
 
+    void dealloc_frames(uint32_t first, uint32_t last) {
+        LockGuard g{lock};
+
+        ASSERT(offset(first) == 0);
+        ASSERT(offset(last) == 0);
+
+        ((Frame*) last)->next = firstFree;
+        firstFree = (Frame*) first;
+    }
+
 
     void init(uint32_t start, uint32_t size) {
         ASSERT(offset(start) == 0);
@@ -27,6 +27,38 @@ namespace PhysMem {
     uint32_t alloc_frame();
 
     void dealloc_frame(uint32_t);
+
+    // returns a chain of frames linked through their first word in one go
+    void dealloc_frames(uint32_t first, uint32_t last);
+
+    // collects freed frames so they can be handed back under a single lock
+    class FrameBatch {
+        uint32_t first;
+        uint32_t last;
+
+    public:
+        FrameBatch() : first(0), last(0) {}
+        FrameBatch(const FrameBatch&) = delete;
+        ~FrameBatch() {
+            flush();
+        }
+
+        void add(uint32_t p) {
+            *((uint32_t*) p) = first;
+            if (first == 0) {
+                last = p;
+            }
+            first = p;
+        }
+
+        void flush() {
+            if (first != 0) {
+                dealloc_frames(first, last);
+                first = 0;
+                last = 0;
+            }
+        }
+    };
 }
 
 #endif
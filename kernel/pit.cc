@@ -2,6 +2,7 @@
 
 #include "debug.h"
 #include "idt.h"
+#include "init.h"
 #include "machine.h"
 #include "process.h"
 #include "smp.h"
@@ -14,13 +15,14 @@
  * know
  *
  * Here is plan:
- *    we're going to use the PIT to count how many cycles it takes
- *    for the APIT to run at the frequency we want then we're going
- *    to switch over to the APIT and abandon our old trusty friend
+ *    ask the CPU (or the hypervisor) how fast the APIT and the TSC run.
+ *    If nobody tells us, we use the PIT to count how many cycles it
+ *    takes for the APIT to run at the frequency we want. Either way we
+ *    then switch over to the APIT and abandon our old trusty friend
  *
  *    Running on an emulator complicates things because the emulator
- *    will never get timing exactly right so we try to do the calibration
- *    in a loop and hope for the best
+ *    will never get timing exactly right, the measured window starts on
+ *    a PIT edge so at least we don't lose part of a period
  */
 
 /* The standard frequency of the PIT */
@@ -31,6 +33,8 @@ constexpr uint32_t APIT_vector = 40;
 
 uint32_t Pit::jiffiesPerSecond = 0;
 uint32_t Pit::apitCounter = 0;
+uint32_t Pit::tscPerJiffy = 0;
+TimePage Pit::timePage{};
 volatile uint32_t Pit::jiffies = 0;
 
 struct PitInfo {
@@ -38,31 +42,76 @@ struct PitInfo {
 
 static PitInfo* pitInfo = nullptr;
 
-/* Do what you need to do in order to run the APIT at the given
- * frequency. Should be called by the bootstrap CPI
+/* the TSC to nanoseconds multiplier is scaled up by 2^NANOS_SHIFT */
+constexpr uint32_t NANOS_SHIFT = 24;
+
+/* n / d for when the quotient fits in 32 bits, we have no 64 bit division */
+static uint32_t div_64_32(uint64_t n, uint32_t d) {
+    uint32_t q, r;
+    asm("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+}
+
+/* What calibration finds out. A 16th of the TSC rate so it fits in 32 bits for any real CPU */
+struct Rates {
+    uint32_t apit_hz;
+    uint32_t tsc_hz_16;
+};
+
+/* Hypervisors that follow the VMware convention report both rates in kHz in leaf 0x40000010 */
+static bool rates_from_hypervisor(Rates& rates) {
+    cpuid_out out;
+    cpuid(0x40000000, &out);
+    if (out.a < 0x40000010) return false;
+
+    cpuid(0x40000010, &out);
+    if (out.a == 0 || out.b == 0) return false;
+
+    rates.tsc_hz_16 = (uint32_t)(((uint64_t)out.a * 1000) >> 4);
+    rates.apit_hz = out.b * 1000;
+    return true;
+}
+
+/*
+ * Leaf 0x15 gives the crystal clock and the TSC/crystal ratio, the APIT
+ * runs off the crystal. Some parts leave the crystal out, then we work it
+ * back from the base frequency in leaf 0x16 as the TSC runs at base
  */
-void Pit::calibrate(uint32_t hz) {
-    pitInfo = new PitInfo();
+static bool rates_from_cpuid(Rates& rates) {
+    cpuid_out out;
+    cpuid(0, &out);
+    uint32_t max_leaf = out.a;
+    if (max_leaf < 0x15) return false;
 
-    // Our objective is to count how many APIT tickes happen in
-    // a second. To do that we're going to program the PIT at
-    // 20Hz and wait for it to signal us 20 times, giving us
-    // a delay if 1 second.
-    //
-    // We will set the APIT counter to 0xffffffff at the begining
-    // of the second and see how far it went at the end and this
-    // will help us determine its frequency
-    //
-    // Why 20Hz? becasue the PIT has a fixed frequency of 1193182Hz
-    // and a 16 bit divider, 20Hz will require a divider of 59658 which
-    // we can fit in 16 bits
+    cpuid(0x15, &out);
+    uint32_t denominator = out.a;
+    uint32_t numerator = out.b;
+    uint32_t crystal = out.c;
+    if (denominator == 0 || numerator == 0) return false;
 
-    SMP::apit_lvt_timer.set(0x00010000);  // oneshot, masked, ...
-    SMP::apit_divide.set(0x0000000B);     // divide by 1
+    if (crystal == 0) {
+        if (max_leaf < 0x16) return false;
+        cpuid(0x16, &out);
+        uint32_t base_mhz = out.a & 0xffff;
+        if (base_mhz == 0) return false;
+        crystal = div_64_32((uint64_t)base_mhz * 1000000 * denominator, numerator);
+    }
 
-    // Now let's program the PIT to compute the frequency
-    Debug::printf("| pitInit freq %dHz\n", hz);
-    uint32_t d = PIT_FREQ / 20;
+    rates.apit_hz = crystal;
+    rates.tsc_hz_16 = div_64_32((uint64_t)crystal * numerator, denominator * 16);
+    return true;
+}
+
+/*
+ * Count APIT ticks and TSC cycles over about 10ms of PIT time.
+ *
+ * The PIT is programmed at 200Hz in square wave mode. Its output changes
+ * twice per period so 4 changes make the window, and we start counting on
+ * a change so the window is whole periods. The exact window is
+ * 2 * d / PIT_FREQ seconds which we scale back up to a second
+ */
+static void rates_from_pit(Rates& rates) {
+    uint32_t d = PIT_FREQ / 200;
 
     if ((d & 0xffff) != d) {
         Debug::printf("| pitInit invalid divider %d\n", d);
@@ -70,9 +119,6 @@ void Pit::calibrate(uint32_t hz) {
     }
     Debug::printf("| pitInit divider %d\n", d);
 
-    uint32_t initial = 0xffffffff;
-    SMP::apit_initial_count.set(initial);
-
     outb(0x61, 1);  // speaker off, gate on
 
     outb(0x43, 0b10110110);  //  10 -> channel#2
@@ -84,29 +130,66 @@ void Pit::calibrate(uint32_t hz) {
     outb(0x42, d);
     outb(0x42, d >> 8);
 
-    uint32_t last = inb(0x61) & 0x20;
-    uint32_t changes = 0;
-    // The PIT counts twice as fast when it runs in the
-    // square-wave generator mode. So, the state is
-    // really changing at 40Hz and we should loop
-    // for 40 iterations if we want to wait for a second
-    //
-    while (changes < 40) {
-        uint32_t t = inb(0x61) & 0x20;
-        if (t != last) {
-            changes++;
-            last = t;
-        }
+    auto wait_change = [](uint32_t last) {
+        uint32_t t;
+        while ((t = inb(0x61) & 0x20) == last)
+            ;
+        return t;
+    };
+
+    uint32_t last = wait_change(inb(0x61) & 0x20);
+
+    uint32_t initial = 0xffffffff;
+    SMP::apit_initial_count.set(initial);
+    uint64_t tsc_start = rdtsc();
+
+    for (uint32_t changes = 0; changes < 4; changes++) {
+        last = wait_change(last);
     }
 
-    uint32_t diff = initial - SMP::apit_current_count.get();
+    uint32_t apit_diff = initial - SMP::apit_current_count.get();
+    uint64_t tsc_diff = rdtsc() - tsc_start;
 
     // stop the PIT
     outb(0x61, 0);
 
-    Debug::printf("| APIT running at %uHz\n", diff);
-    apitCounter = diff / hz;
+    rates.apit_hz = div_64_32((uint64_t)apit_diff * PIT_FREQ, 2 * d);
+    rates.tsc_hz_16 = div_64_32((tsc_diff >> 4) * PIT_FREQ, 2 * d);
+}
+
+/* Do what you need to do in order to run the APIT at the given
+ * frequency. Should be called by the bootstrap CPI
+ */
+void Pit::calibrate(uint32_t hz) {
+    pitInfo = new PitInfo();
+
+    SMP::apit_lvt_timer.set(0x00010000);  // oneshot, masked, ...
+    SMP::apit_divide.set(0x0000000B);     // divide by 1
+
+    Debug::printf("| pitInit freq %dHz\n", hz);
+
+    uint64_t tsc_start = rdtsc();
+    Rates rates;
+    // a hypervisor's APIT doesn't have to run off the crystal it reports in 0x15
+    if (onHypervisor ? rates_from_hypervisor(rates) : rates_from_cpuid(rates)) {
+        Debug::printf("| rates from CPUID\n");
+    } else {
+        rates_from_pit(rates);
+        Debug::printf("| rates measured with the PIT\n");
+    }
+
+    Debug::printf("| APIT running at %uHz\n", rates.apit_hz);
+    apitCounter = rates.apit_hz / hz;
     jiffiesPerSecond = hz;
+    tscPerJiffy = (rates.tsc_hz_16 / hz) << 4;
+    Debug::printf("| TSC %u cycles per jiffy\n", tscPerJiffy);
+
+    // a second of nanoseconds over a second of TSC, both scaled down by 16 to stay in range
+    timePage.tsc_base = tsc_start;
+    timePage.shift = NANOS_SHIFT;
+    timePage.mult = div_64_32((uint64_t)1000000000 << (NANOS_SHIFT - 4), rates.tsc_hz_16);
+    timePage.hz = hz;
+    Debug::printf("| TSC to ns multiplier %u >> %u\n", timePage.mult, timePage.shift);
     Debug::printf("| APIT counter=%d for %dHz\n", apitCounter, hz);
 
     // Register the APIT interrupt handler
@@ -123,6 +206,10 @@ void Pit::init() {
 
     // The following line will enable timer interrupts for this CPU
     // You better be prepared for it
+    periodic();
+}
+
+void Pit::periodic() {
     SMP::apit_lvt_timer.set(
         (1 << 17) |  // Timer mode: 1 -> Periodic
         0 << 16 |    // mask: 0 -> interrupts not masked
@@ -133,17 +220,47 @@ void Pit::init() {
     SMP::apit_initial_count.set(apitCounter);
 }
 
+void Pit::idle(uint32_t max_jiffies, bool use_mwait) {
+    if (max_jiffies == 0) {
+        return;
+    }
+
+    if (SMP::me() != 0) {
+        // don't overflow the 32 bit count
+        uint32_t most = 0xffffffff / apitCounter;
+        if (max_jiffies > most) max_jiffies = most;
+
+        SMP::apit_lvt_timer.set(
+            (0 << 17) |  // Timer mode: 0 -> One shot
+            0 << 16 |    // mask: 0 -> interrupts not masked
+            APIT_vector  // the interrupt vector
+        );
+        SMP::apit_initial_count.set(apitCounter * max_jiffies);
+    }
+
+    if (use_mwait) {
+        sti_mwait();
+    } else {
+        sti_hlt();
+    }
+
+    cli();
+    if (SMP::me() != 0) {
+        periodic();
+    }
+}
+
 using namespace ProcessManagement;
 
 extern "C" void apitHandler(RegisterState* regs) {
     // interrupts are disabled.
     auto id = SMP::me();
     if (id == 0) {
-        Pit::jiffies = Pit::jiffies + 1;
+        Pit::tick();
+        // one core is enough for the shared VGA cursor
+        TextUI::render->update_cursor();
     }
     SMP::eoi_reg.set(0);
-    
-    TextUI::render->update_cursor();
 
     // this requires interrupts disabled
     // this may or may not return, but its safe to that by this point
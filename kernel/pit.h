@@ -7,16 +7,76 @@
 #include "debug.h"
 // #include "texteditor.h"
 
+/**
+ * the clock as user programs see it at VA_USER_TIME, read only for them.
+ * nanoseconds since boot = ((rdtsc() - tsc_base) * mult) >> shift.
+ * it has a page to itself so nothing else of the kernel shows through
+ */
+struct alignas(4096) TimePage {
+    uint64_t tsc_base;
+    uint32_t mult;
+    uint32_t shift;
+    uint32_t hz;
+    volatile uint32_t jiffies;
+};
+
 class Pit {
     static uint32_t jiffiesPerSecond;
     static uint32_t apitCounter;
+    static uint32_t tscPerJiffy;
+    static TimePage timePage;
 public:
     static volatile uint32_t jiffies;
     static void calibrate(uint32_t hz);
     static void init();
+    static void periodic();
+
+    // called on core 0 for every tick
+    static void tick() {
+        jiffies = jiffies + 1;
+        timePage.jiffies = jiffies;
+    }
+
+    /**
+     * stops the tick on this core and halts until an interrupt comes in or
+     * at most the given number of jiffies pass, then goes back to the periodic tick.
+     * with use_mwait it also wakes up on a write to whatever was passed to monitor.
+     * core 0 keeps ticking as it owns jiffies.
+     * call with interrupts disabled, returns with them disabled
+     */
+    static void idle(uint32_t max_jiffies, bool use_mwait = false);
     static uint32_t secondsToJiffies(uint32_t secs) {
         return jiffiesPerSecond * secs;
     }
+    // rounds up, so a wait of a few ms is at least that long
+    static uint32_t millisToJiffies(uint32_t ms) {
+        return ms / 1000 * jiffiesPerSecond + ((ms % 1000) * jiffiesPerSecond + 999) / 1000;
+    }
+    static uint32_t jiffies_until(uint32_t at) {
+        uint32_t now = jiffies;
+        return at > now ? at - now : 0;
+    }
+    // how far the TSC moves in a jiffy, measured alongside the APIT
+    static uint32_t tsc_per_jiffy() {
+        return tscPerJiffy;
+    }
+    static TimePage& time_page() {
+        return timePage;
+    }
+
+    // converts TSC cycles to nanoseconds without dividing
+    static uint64_t cycles_to_nanos(uint64_t cycles) {
+        uint64_t lo = (cycles & 0xffffffff) * timePage.mult;
+        uint64_t hi = (cycles >> 32) * timePage.mult;
+        return (hi << (32 - timePage.shift)) + (lo >> timePage.shift);
+    }
+
+    // nanoseconds since the TSC was calibrated. the TSC is invariant and
+    // in step across cores, so this never goes backwards when we migrate
+    static uint64_t nanos() {
+        return cycles_to_nanos(rdtsc() - timePage.tsc_base);
+    }
+
     static uint32_t seconds(void) {
         return jiffies / jiffiesPerSecond;
         return 0;
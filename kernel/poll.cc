@@ -0,0 +1,115 @@
+#include "poll.h"
+#include "pit.h"
+
+namespace UserFileIO {
+
+    uint32_t poll_scan(OpenFile* files, PollFd* fds, uint32_t count) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            // negative fds are left out, like the user's poll
+            if (fds[i].fd < 0) {
+                fds[i].revents = 0;
+                continue;
+            }
+            if (files[i].uf == Shared<UserFileContainer>::NUL) {
+                fds[i].revents = POLLNVAL;
+            } else {
+                fds[i].revents = files[i].ready() & fds[i].events;
+            }
+            if (fds[i].revents != 0) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    Poll::Poll(ProcessManagement::Process me, PollFd* user_fds, OpenFile* files, PollFd* fds, uint32_t count)
+        : me(me), user_fds(user_fds), files(files), fds(fds), count(count) {}
+
+    Poll::~Poll() {
+        delete[] files;
+        delete[] fds;
+    }
+
+    void Poll::unref() {
+        if (refs.add_fetch(-1) == 0) {
+            delete this;
+        }
+    }
+
+    void Poll::start(ProcessManagement::Process me, PollFd* user_fds, OpenFile* files, PollFd* fds,
+                     uint32_t count, int timeout_ms) {
+        Poll* p = new Poll(me, user_fds, files, fds, count);
+
+        // every fd left is open, a bad one would have been answered without waiting
+        for (uint32_t i = 0; i < count; i++) {
+            if (fds[i].fd >= 0) {
+                files[i].watch(p);
+            }
+        }
+
+        if (timeout_ms > 0) {
+            p->refs.add_fetch(1);
+            go([p] {
+                p->finish(true);
+                p->unref();
+            }, Pit::millisToJiffies(timeout_ms));
+        }
+
+        // something may have come in between the first look and the watches
+        p->finish(false);
+        p->unref();
+    }
+
+    // the list is locked, so the looking happens later
+    void Poll::changed() {
+        if (done.get() != 0) {
+            return;
+        }
+        refs.add_fetch(1);
+        go([this] {
+            finish(false);
+            unref();
+        });
+    }
+
+    void Poll::finish(bool timed_out) {
+        using namespace ProcessManagement;
+
+        LockGuard g{lock};
+        if (done.get() != 0) {
+            return;
+        }
+
+        // the answers outlive us, they go to me once it runs
+        PollFd* got = new PollFd[count];
+        memcpy(got, fds, count * sizeof(PollFd));
+        uint32_t n = poll_scan(files, got, count);
+
+        if (n == 0 && !timed_out) {
+            delete[] got;
+            return;
+        }
+        done.set(1);
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (fds[i].fd >= 0) {
+                files[i].unwatch(this);
+            }
+        }
+        delete[] files;
+        files = nullptr;
+
+        me.schedule([user_fds = user_fds, got, count = count, n] {
+            for (uint32_t i = 0; i < count; i++) {
+                user_fds[i].revents = got[i].revents;
+            }
+            delete[] got;
+            PCB::current().regs.eax = n;
+        });
+
+        // off their lists, the watchers are done with us. whoever called still has theirs
+        unref();
+    }
+
+}  // namespace UserFileIO
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "atomic.h"
+#include "file.h"
+#include "process.h"
+#include "watch.h"
+
+namespace UserFileIO {
+
+/**
+ * one entry of a poll, laid out like the user's struct pollfd
+ */
+struct PollFd {
+    int fd;
+    short events;
+    short revents;
+};
+
+/**
+ * fills in revents for the count entries, files holds the open file of each valid fd.
+ * returns how many entries have something to say
+ */
+extern uint32_t poll_scan(OpenFile* files, PollFd* fds, uint32_t count);
+
+/**
+ * a poll that has to wait. it watches every file it was given, and a timer when it has
+ * a timeout, and the first of them to see it through finishes it: the process gets
+ * the answers and anything that comes in after that finds the poll done
+ */
+class Poll : public Watcher {
+    ProcessManagement::Process const me;
+    // where the answers go, in me's memory
+    PollFd* const user_fds;
+    // kept open for us, me may close them while we wait. let go as soon as we are done,
+    // the timer can hold the poll for much longer
+    OpenFile* files;
+    PollFd* const fds;
+    uint32_t const count;
+
+    // one finish looks at a time, so none is scanning the files as they go
+    SpinLock lock{};
+    Atomic<uint32_t> done{0};
+    // start's, the watch lists', the timer's and one per change on its way to us
+    Atomic<uint32_t> refs{2};
+
+    Poll(ProcessManagement::Process me, PollFd* user_fds, OpenFile* files, PollFd* fds, uint32_t count);
+    ~Poll();
+
+    void unref();
+
+    /**
+     * lets me go with the answers if any are ready or the time is up
+     */
+    void finish(bool timed_out);
+
+   public:
+    /**
+     * waits until one of the files is ready or timeout_ms pass, negative waits for good.
+     * takes the files and fds arrays, call it from block
+     */
+    static void start(ProcessManagement::Process me, PollFd* user_fds, OpenFile* files, PollFd* fds,
+                      uint32_t count, int timeout_ms);
+
+    virtual void changed() override;
+};
+
+}  // namespace UserFileIO
@@ -1,6 +1,8 @@
 #include "process.h"
 
 #include "debug.h"
+#include "rcu.h"
+#include "sys.h"
 #include "tss.h"
 #include "vmm.h"
 
@@ -10,6 +12,102 @@ Atomic<uint32_t> next_pid{0};
 PerCPU<bool> preempt_flag{};
 Process default_kernel_process{PageNum(PageNum::BAD_NUM)};
 PerCPU<Process> default_kernel_per_core_process{};
+PerCPU<uint32_t> loaded_pd{};
+
+// the same table as Linux, nice 0 is 2^22
+const uint32_t nice_to_wmult[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 48388, 59856, 76040, 92818, 118348,
+    /* -15 */ 147320, 184698, 229616, 287308, 360437,
+    /* -10 */ 449829, 563644, 704093, 875809, 1099582,
+    /*  -5 */ 1376151, 1717300, 2157191, 2708050, 3363326,
+    /*   0 */ 4194304, 5237765, 6557202, 8165337, 10153587,
+    /*   5 */ 12820798, 15790321, 19976592, 24970740, 31350126,
+    /*  10 */ 39045157, 49367440, 61356676, 76695844, 95443717,
+    /*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+// how long a process keeps the core while other processes wait, in jiffies
+constexpr uint32_t SCHED_SLICE = 3;
+
+// how far below the others a process coming back from sleep may start, in jiffies
+constexpr uint32_t SCHED_WAKEUP_CREDIT = 3;
+
+// how far behind a waiting process has to be to cut the running one's slice short, in jiffies
+constexpr uint32_t SCHED_WAKEUP_GRANULARITY = 1;
+
+// how often the balancer evens out the run queues, in jiffies
+constexpr uint32_t BALANCE_EVERY = 10;
+
+uint32_t allowed_cores(PCB& pcb) {
+    uint32_t all = kConfig.totalProcs >= 32 ? 0xffffffff : (1 << kConfig.totalProcs) - 1;
+    uint32_t allowed = pcb.affinity & all;
+    // the affinity syscall never leaves it empty, but the kernel process can be anywhere
+    return allowed == 0 ? all : allowed;
+}
+
+uint32_t pick_core(PCB& pcb) {
+    uint32_t allowed = allowed_cores(pcb);
+    if (pcb.last_cpu < kConfig.totalProcs && (allowed & (1 << pcb.last_cpu)) != 0) {
+        return pcb.last_cpu;
+    }
+
+    // never ran or not allowed there anymore, so the least loaded core it may use
+    uint32_t best = __builtin_ctz(allowed);
+    for (uint32_t i = best + 1; i < kConfig.totalProcs; i++) {
+        if ((allowed & (1 << i)) != 0 && impl::ordered_load(i) < impl::ordered_load(best)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// set by the core that starts the balancer
+static Atomic<uint32_t> balancing{0};
+
+static void balance() {
+    impl::balance_ordered();
+    go([] {
+        balance();
+    }, BALANCE_EVERY);
+}
+
+uint64_t queue_vruntime(PCB& pcb, uint32_t core) {
+    uint64_t floor = impl::ordered_floor(core);
+    uint64_t credit = (uint64_t)SCHED_WAKEUP_CREDIT * Pit::tsc_per_jiffy();
+    if (floor > credit && pcb.vruntime < floor - credit) {
+        pcb.vruntime = floor - credit;
+    }
+    return pcb.vruntime;
+}
+
+// called on a tick while the process is in user mode
+static bool should_preempt(PCB& pcb) {
+    using namespace impl;
+
+    // the process is exiting, the thread leaves when it is next resumed
+    if (!(pcb.group == Shared<ThreadGroup>::NUL) && pcb.group->exiting.get()) {
+        return true;
+    }
+
+    // nobody else wants the core
+    if (!work_waiting()) {
+        return false;
+    }
+
+    // only kernel work is waiting, it is short so let it right in
+    uint64_t lowest = lowest_ordered();
+    if (lowest == 0xffffffffffffffff) {
+        return true;
+    }
+
+    uint64_t ran = rdtsc() - pcb.resumed_at;
+    if (ran >= (uint64_t)SCHED_SLICE * Pit::tsc_per_jiffy()) {
+        return true;
+    }
+
+    // someone that just woke up is well behind us, don't make them wait out our slice
+    return lowest + SCHED_WAKEUP_GRANULARITY * Pit::tsc_per_jiffy() < pcb.vruntime + pcb.weighted(ran);
+}
 
 void* PCB::operator new(size_t sz, void* p) {
     return p;
@@ -17,7 +115,8 @@ void* PCB::operator new(size_t sz, void* p) {
 
 Process Process::create_like(Process process_to_copy) {
     // create the new proc
-    Process new_proc = create_page_dir_like(process_to_copy.pd);
+    // only the page tables the original ever populated need to be shared
+    Process new_proc = create_page_dir_like(process_to_copy.pd, &process_to_copy.pcb_phys().populated_pdes);
 
     // handle page faults immediately for kernel data (as kernel will just bypass the read only)
     // we need a new page for the current process. we can use the default block list as every PD
@@ -31,9 +130,174 @@ Process Process::create_like(Process process_to_copy) {
     new (&new_proc.pcb_phys()) PCB(process_to_copy.pcb_phys().regs,
                                    create_mmap_tree_like(process_to_copy.pcb_phys().mmap_tree));
 
+    // the copy shares every page with the original
+    new_proc.pcb_phys().mem_stats.resident_pages = process_to_copy.pcb_phys().stats().resident_pages;
+    new_proc.pcb_phys().populated_pdes = process_to_copy.pcb_phys().populated_pdes;
+
+    // the copy picks up where the original is, it does not get to jump the line
+    new_proc.pcb_phys().vruntime = process_to_copy.pcb_phys().vruntime;
+    new_proc.pcb_phys().nice = process_to_copy.pcb_phys().nice;
+    new_proc.pcb_phys().affinity = process_to_copy.pcb_phys().affinity;
+
     return new_proc;
 }
 
+Process Process::create_thread(Process creator, uint32_t eip, uint32_t esp) {
+    PCB& creator_pcb = creator.pcb_phys();
+    RBTree<MMAPBlock*, NoLock>* mmap_tree = creator_pcb.mmap_tree;
+
+    // every user page table has to exist before the thread is made, so both see the same frames
+    populate_page_tables(mmap_tree, creator.pd, VA_USER_START, VA_USER_PRIVATE_END, &creator_pcb.populated_pdes);
+    Process new_thread = create_thread_page_dir(creator.pd, VA_USER_START, VA_USER_PRIVATE_END, &creator_pcb.populated_pdes);
+
+    // the PCB page and the shared page are per thread, same as a fork
+    handle_page_fault(mmap_tree, new_thread.pd, VA_PROCESS, true);
+    handle_page_fault(mmap_tree, creator.pd, VA_PROCESS, true);
+
+    RegisterState regs{};
+    regs.eip = eip;
+    regs.esp_user = esp;
+    regs.cs = creator_pcb.regs.cs;
+    regs.ss = creator_pcb.regs.ss;
+    regs.flags = creator_pcb.regs.flags;
+
+    PCB& pcb = new_thread.pcb_phys();
+    new (&pcb) PCB(regs, mmap_tree);
+
+    pcb.populated_pdes = creator_pcb.populated_pdes;
+    pcb.active_tui = creator_pcb.active_tui;
+    for (uint32_t i = 0; i < sizeof(pcb.sems) / sizeof(pcb.sems[0]); i++) {
+        pcb.sems[i] = creator_pcb.sems[i];
+    }
+    pcb.working_directory = creator_pcb.working_directory;
+    pcb.files = creator_pcb.files;
+    pcb.handler = creator_pcb.handler;
+    pcb.group = creator_pcb.group;
+
+    pcb.vruntime = creator_pcb.vruntime;
+    pcb.nice = creator_pcb.nice;
+    pcb.affinity = creator_pcb.affinity;
+
+    return new_thread;
+}
+
+int ThreadGroup::add(Process thread, Shared<ExitHandle> exit) {
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        if (members[tid].pd.ppn() == PageNum::BAD_NUM && exits[tid] == Shared<ExitHandle>::NUL) {
+            members[tid] = thread;
+            exits[tid] = exit;
+            return tid;
+        }
+    }
+    return -1;
+}
+
+bool ThreadGroup::remove(Process thread) {
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        if (members[tid] == thread) {
+            members[tid] = Process();
+        }
+    }
+    return stop_waiting(thread);
+}
+
+bool ThreadGroup::exit_all(Process thread, Shared<ExitHandle> exit, int rc, const MemStats& final_stats) {
+    if (!(members[0] == thread)) {
+        return false;
+    }
+
+    // pairs with park, either we see a thread blocked or it sees us exiting and stops our wait
+    exiting.set(1);
+    for (uint32_t tid = 1; tid < MAX_THREADS; tid++) {
+        if (members[tid].pd.ppn() != PageNum::BAD_NUM && members[tid].pcb_phys().parked.get() == 0) {
+            waited |= 1 << tid;
+        }
+    }
+    if (waited == 0) {
+        return false;
+    }
+
+    group_exit = exit;
+    group_rc = rc;
+    group_stats = final_stats;
+    return true;
+}
+
+bool ThreadGroup::stop_waiting(Process thread) {
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        if ((waited & (1 << tid)) != 0 && members[tid] == thread) {
+            waited &= ~(1 << tid);
+            return waited == 0;
+        }
+    }
+    return false;
+}
+
+void ThreadGroup::finish_exit() {
+    Shared<ExitHandle> exit = group_exit;
+    group_exit = Shared<ExitHandle>::NUL;
+    exit->exit(group_rc, group_stats);
+}
+
+void ThreadGroup::flush_other_tlbs() {
+    // pairs with Process::change storing loaded_pd before loading CR3, either we see
+    // the core has one of our page dirs or it loads it after our changes
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint32_t me = SMP::me();
+    for (uint32_t core = 0; core < kConfig.totalProcs; core++) {
+        if (core == me) {
+            continue;
+        }
+        for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+            if (members[tid].pd.ppn() != PageNum::BAD_NUM && loaded_pd.forCPU(core) == members[tid].pd.ppn()) {
+                SMP::flush_tlb(core);
+                break;
+            }
+        }
+    }
+}
+
+bool ThreadGroup::alone(Process thread) {
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        if (members[tid].pd.ppn() != PageNum::BAD_NUM && !(members[tid] == thread)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Shared<ExitHandle> ThreadGroup::take_exit(int tid) {
+    if (tid < 0 || (uint32_t)tid >= MAX_THREADS) {
+        return Shared<ExitHandle>::NUL;
+    }
+    Shared<ExitHandle> exit = exits[tid];
+    exits[tid] = Shared<ExitHandle>::NUL;
+    return exit;
+}
+
+void ThreadGroup::share_page_tables(Process from, VirtualAddress start, VirtualAddress end) {
+    PCB& from_pcb = from.pcb_phys();
+    populate_page_tables(mmap_tree, from.pd, start, end, &from_pcb.populated_pdes);
+
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        Process other = members[tid];
+        if (other.pd.ppn() == PageNum::BAD_NUM || other == from) {
+            continue;
+        }
+
+        PCB& other_pcb = other.pcb_phys();
+        for (uint32_t pdi = page_num(start).pdi(); pdi <= page_num(end - 1).pdi(); pdi++) {
+            PageEntry& pde = from.pd[pdi];
+            if (pde.flags().is_not(Flags::PRESENT) || other.pd[pdi].flags().is(Flags::PRESENT)) {
+                continue;
+            }
+            other.pd[pdi].smart_set(pde);
+            other_pcb.populated_pdes.set(pdi);
+        }
+    }
+}
+
 void Process::destroy(Process process_to_delete) {
     // don't delete the default process
     if (process_to_delete == default_kernel_process || process_to_delete == default_kernel_per_core_process.mine()) {
@@ -47,11 +311,49 @@ void Process::destroy(Process process_to_delete) {
 
     PCB& process_to_delete_pcb = process_to_delete.pcb_phys();
     RBTree<MMAPBlock*, NoLock>* mmap_tree = process_to_delete_pcb.mmap_tree;
+    Shared<ThreadGroup> group = process_to_delete_pcb.group;
+    if (!(group == Shared<ThreadGroup>::NUL)) {
+        bool last_out;
+        {
+            LockGuard g{group->lock};
+            last_out = group->remove(process_to_delete);
+        }
+        if (last_out) {
+            group->finish_exit();
+        }
+    }
     process_to_delete_pcb.~PCB();
 
-    // destroy the process
-    destroy_page_dir(mmap_tree, process_to_delete.pd);
-    destroy_mmap_tree(mmap_tree);
+    // the page dir is detached now, so tearing it down can wait for an idle core
+    reap(process_to_delete.pd, mmap_tree, group);
+}
+
+void Process::reap(PageDir pd, RBTree<MMAPBlock*, NoLock>* mmap_tree, Shared<ThreadGroup> group) {
+    // the closure holds a reference to the pd, so its frame outlives the process
+    go_idle([pd, mmap_tree, group, threaded = !(group == Shared<ThreadGroup>::NUL)] {
+        // cores that ran it last may still have it loaded, wait for them to move on
+        if (current_cr3().ppn() == pd.ppn()) {
+            release_address_space();
+        }
+        for (uint32_t i = 0; i < kConfig.totalProcs; i++) {
+            if (loaded_pd.forCPU(i) == pd.ppn()) {
+                go([pd, mmap_tree, group] {
+                    reap(pd, mmap_tree, group);
+                }, 1);
+                return;
+            }
+        }
+
+        if (!threaded) {
+            destroy_page_dir(mmap_tree, pd);
+            destroy_mmap_tree(mmap_tree);
+            return;
+        }
+
+        // the other threads still use the tree, the last one to go takes it with the group
+        LockGuard g{group->lock};
+        destroy_page_dir(mmap_tree, pd);
+    });
 }
 
 void global_init() {
@@ -68,11 +370,18 @@ void global_init() {
     new (&default_pcb) PCB(RegisterState(),
                            create_mmap_tree_like(default_mmap_tree));
 
+    // the kernel page tables came from the default page dir, so find them once here
+    default_pcb.populated_pdes = PdeBitmap::of(default_kernel_process.pd);
+
     // map the default user space and shared frame
     VirtualAddress va_user_stack = VA_USER_PRIVATE_END - (1024 * 1024);
     ASSERT(mmap(default_pcb.mmap_tree, va_user_stack, 1024 * 1024, Flags::MMAP_FIXED | Flags::MMAP_RW | Flags::MMAP_REAL | Flags::MMAP_USER, Shared<Node>(), 0, 0) == (void*)va_user_stack);
     ASSERT(mmap(default_pcb.mmap_tree, VA_USER_SHARED_START, VA_USER_SHARED_END - VA_USER_SHARED_START, Flags::MMAP_FIXED | Flags::MMAP_RW | Flags::MMAP_REAL | Flags::MMAP_USER | Flags::MMAP_SHARED, Shared<Node>(), 0, 0) == (void*)VA_USER_SHARED_START);
-    handle_page_fault(default_pcb.mmap_tree, default_kernel_process.pd, VA_USER_SHARED_START, true);
+    handle_page_fault(default_pcb.mmap_tree, default_kernel_process.pd, VA_USER_SHARED_START, true, &default_pcb.mem_stats, &default_pcb.populated_pdes);
+
+    // the clock is the same frame everywhere and read only for users
+    ASSERT(mmap(default_pcb.mmap_tree, VA_USER_TIME, PAGE_SIZE, Flags::MMAP_FIXED | Flags::MMAP_SHARED, Shared<Node>(), 0, 0) == (void*)VA_USER_TIME);
+    map_kernel_frame(default_pcb.mmap_tree, default_kernel_process.pd, VA_USER_TIME, (PhysicalAddress)&Pit::time_page(), Flags::USER_SUPERVISOR, &default_pcb.populated_pdes);
 
     for (uint32_t i = 0; i < kConfig.totalProcs; i++) {
         default_kernel_per_core_process.forCPU(i) = Process::create_like(default_kernel_process);
@@ -81,6 +390,40 @@ void global_init() {
 
 void per_core_init() {
     Process::change(default_kernel_per_core_process.mine());
+
+    // idle cores pull work for themselves, this catches the busy ones.
+    // events come from per-CPU pools, so it waits for a core that has its %gs
+    if (kConfig.totalProcs > 1 && balancing.exchange(1) == 0) {
+        go([] {
+            balance();
+        }, BALANCE_EVERY);
+    }
+}
+
+void leave_exiting_group() {
+    SYS::Call::exit(0);
+}
+
+void park(PCB& pcb) {
+    pcb.parked.set(1);
+
+    if (pcb.group == Shared<ThreadGroup>::NUL || pcb.group->exiting.get() == 0) {
+        return;
+    }
+
+    Shared<ThreadGroup> group = pcb.group;
+    bool last;
+    {
+        LockGuard g{group->lock};
+        last = group->stop_waiting(Process::current());
+    }
+    if (last) {
+        group->finish_exit();
+    }
+}
+
+void release_address_space() {
+    Process::change(default_kernel_per_core_process.mine());
 }
 
 void yield() {
@@ -113,6 +456,14 @@ void handle_timer(RegisterState* regs) {
         return;
     }
 
+    // user mode holds nothing the kernel might free
+    Rcu::note_quiescent();
+
+    // keep running unless someone else should have the core
+    if (!should_preempt(PCB::current())) {
+        return;
+    }
+
     // yield to somewhere else
     PCB::current().save_state(regs);
     block([](Process me) {
@@ -120,19 +471,4 @@ void handle_timer(RegisterState* regs) {
         sti();
     });
 }
-
-void block_and_sync(Shared<Barrier>& trigger) {
-    using namespace ProcessManagement;
-
-    // block here
-    block([&trigger](Process me) {
-        // only allow the schedule of the process when we have safely disconnected from the process PD
-        trigger->sync([me] {
-            me.schedule();
-        });
-
-        // consume the barrier
-        trigger = Shared<Barrier>::NUL;
-    });
-}
 }  // namespace ProcessManagement
\ No newline at end of file
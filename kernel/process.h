@@ -20,6 +20,7 @@ struct RegisterState;
 class ExitHandle;
 struct PCB;
 class Process;
+class ThreadGroup;
 
 /**
  * names the stuff that gets pushed when doing an interrupt
@@ -59,11 +60,15 @@ struct RegisterState {
  */
 class ExitHandle {
     Future<int> status;
+    Shared<MemStats> stats;
 
    public:
     inline ExitHandle();
 
-    inline void exit(int rc);
+    /**
+     * exits with the given code, leaving the memory stats of the child behind
+     */
+    inline void exit(int rc, const MemStats& final_stats);
     inline void wait(Process me);
 };
 
@@ -95,7 +100,21 @@ struct PCB {
     Shared<SemaphoreHandle> sems[100];
 
     Shared<Node> working_directory;
-    OpenFile user_files[10];
+    Shared<FileTable> files;
+    // the files the running call is using, so another thread's close can't free them under it
+    OpenFile in_use[2];
+    // set while blocked in the kernel, from block until someone schedules it again
+    Atomic<uint32_t> parked;
+
+    MemStats mem_stats;  // the address space's counters until it is shared, see stats()
+    MemStats children_mem_stats;
+    PdeBitmap populated_pdes;
+    uint32_t last_cpu;  // the core this was last made current on, its TLB is the only one up to date
+    uint64_t vruntime;    // TSC cycles spent running, weighted by nice. the lowest runs next
+    uint64_t resumed_at;  // TSC when it last went back to user mode
+    int nice;
+    uint32_t affinity;  // the cores it may run on, one bit each
+    Shared<ThreadGroup> group;  // null until the process makes its first thread
 
     void (* handler)(int, unsigned);
     bool in_signal_handler;
@@ -127,6 +146,22 @@ struct PCB {
      */
     inline void resume();
 
+    /**
+     * what running for the given number of TSC cycles adds to the vruntime at our nice level
+     */
+    inline uint64_t weighted(uint64_t cycles) const;
+
+    /**
+     * adds the time since the last resume to the vruntime
+     */
+    inline void charge();
+
+    /**
+     * the memory counters of the whole address space, the group's once threads share it.
+     * update them with the address space lock held
+     */
+    inline MemStats& stats();
+
     /**
      * gets the current pcb
      */
@@ -166,7 +201,8 @@ class Process {
     inline static Process current();
 
     /**
-     * changes the current process to the given process, returning the old process
+     * changes the current process to the given process, returning the old process.
+     * CR3 is left alone if the process is already loaded and was last used on this core
      */
     inline static Process change(Process process_to_switch_to);
 
@@ -175,12 +211,128 @@ class Process {
      */
     static Process create_like(Process process_to_copy);
 
+    /**
+     * creates another thread of the given process that starts at eip with the stack at esp.
+     * it shares the user page tables, mmap tree and open files. call with the group lock held
+     */
+    static Process create_thread(Process creator, uint32_t eip, uint32_t esp);
+
     /**
      * destroys the given process and switches to the default_kernel_process
      * if the given process is the current process. the default_kernel_process
-     * is not destroyable
+     * is not destroyable. the address space itself is reclaimed later
      */
     static void destroy(Process process_to_delete);
+
+    /**
+     * queues the page dir and mmap tree of a destroyed process to be torn down
+     * in the background, so the cost is not paid by whoever destroyed it.
+     * a thread's mmap tree belongs to its group and goes with the group
+     */
+    static void reap(PageDir pd, RBTree<MMAPBlock*, NoLock>* mmap_tree, Shared<ThreadGroup> group);
+};
+
+/**
+ * the threads of one program. each thread is a process with its own page dir and PCB,
+ * the user page tables below VA_USER_PRIVATE_END are the same frames in all of them
+ * and the mmap tree is shared, so faults and mmap changes take the lock
+ */
+class ThreadGroup {
+   public:
+    static constexpr uint32_t MAX_THREADS = 16;
+
+    SpinLock lock{};
+    RBTree<MMAPBlock*, NoLock>* const mmap_tree;
+    // every member's faults count here, taken over from the creator's PCB
+    MemStats mem_stats;
+    // set once the creator exits, the other threads leave instead of going back to user code
+    Atomic<uint32_t> exiting{0};
+
+   private:
+    // a bad page dir when the slot is free, the creator is 0
+    Process members[MAX_THREADS];
+    // kept until someone joins the thread
+    Shared<ExitHandle> exits[MAX_THREADS];
+    // the creator's exit, finished once none of the threads it waits for are left
+    Shared<ExitHandle> group_exit;
+    int group_rc;
+    MemStats group_stats;
+    // one bit per tid the exit waits for, the ones that were running when it started
+    uint32_t waited;
+
+   public:
+    inline explicit ThreadGroup(RBTree<MMAPBlock*, NoLock>* mmap_tree);
+    inline ~ThreadGroup();
+
+    ThreadGroup(const ThreadGroup&) = delete;
+
+    // the rest expect the lock to be held
+
+    /**
+     * adds a thread, returning its id, or -1 if there is no room
+     */
+    int add(Process thread, Shared<ExitHandle> exit);
+
+    /**
+     * takes out a thread that is going away. true if the group exit was waiting on it
+     * and nobody else, then the caller has to finish_exit()
+     */
+    bool remove(Process thread);
+
+    /**
+     * the creator is exiting, so the whole process goes. the other threads are told to
+     * leave, and the creator's exit is kept until the ones running right now are gone.
+     * a blocked thread may never wake up, so it is not waited for, it leaves if it does.
+     * false if this is not the creator or nobody is running, then it just exits
+     */
+    bool exit_all(Process thread, Shared<ExitHandle> exit, int rc, const MemStats& final_stats);
+
+    /**
+     * the thread blocked, the group exit stops waiting for it. true if it was the last
+     * one waited for, then the caller has to finish_exit()
+     */
+    bool stop_waiting(Process thread);
+
+    /**
+     * finishes the creator's exit once remove() or stop_waiting() said so, no lock needed
+     */
+    void finish_exit();
+
+    /**
+     * has every other core running one of the threads drop its TLB, so nothing still
+     * reaches page table entries we just changed. the caller flushes its own
+     */
+    void flush_other_tlbs();
+
+    /**
+     * whether the thread is the only one left running
+     */
+    bool alone(Process thread);
+
+    /**
+     * takes the exit handle of the thread to join it, null if there is none to join
+     */
+    Shared<ExitHandle> take_exit(int tid);
+
+    /**
+     * gives the page tables from's mmap tree covers in [start, end) to every other thread
+     */
+    void share_page_tables(Process from, VirtualAddress start, VirtualAddress end);
+};
+
+/**
+ * keeps the other threads out of the mmap tree and page tables while we look at or change them.
+ * nothing to do for a process without threads
+ */
+class AddressSpaceGuard {
+    Shared<ThreadGroup> group;
+
+   public:
+    inline AddressSpaceGuard();
+    inline explicit AddressSpaceGuard(PCB& pcb);
+    inline ~AddressSpaceGuard();
+
+    AddressSpaceGuard(const AddressSpaceGuard&) = delete;
 };
 
 // ------------- globals -------------
@@ -199,6 +351,33 @@ extern Process default_kernel_process;
 // the per core kernel processes
 extern PerCPU<Process> default_kernel_per_core_process;
 
+// the page dir each core has loaded, so nobody tears down one that is still in use
+extern PerCPU<uint32_t> loaded_pd;
+
+// nice levels, a lower level gets a bigger share of the cpu
+constexpr int NICE_MIN = -20;
+constexpr int NICE_MAX = 19;
+
+// 2^32 / weight for each nice level, a level is worth about 10% of cpu time
+extern const uint32_t nice_to_wmult[NICE_MAX - NICE_MIN + 1];
+
+/**
+ * the core to queue a process that is about to be scheduled on.
+ * it stays where it last ran if it may, its cache is still warm there
+ */
+extern uint32_t pick_core(PCB& pcb);
+
+/**
+ * the cores the process may run on
+ */
+extern uint32_t allowed_cores(PCB& pcb);
+
+/**
+ * the vruntime to queue a process that is about to be scheduled on the core with.
+ * a process coming back from sleep only gets a little credit for the time it was away
+ */
+extern uint64_t queue_vruntime(PCB& pcb, uint32_t core);
+
 // ------------- interface -------------
 
 /**
@@ -212,18 +391,35 @@ extern void global_init();
 extern void per_core_init();
 
 /**
- * switches vmm, blocks the current active process, and runs the callback
- * after the callback is done, sits in event loop if wait is true
+ * blocks the current active process, and runs the callback
+ * after the callback is done, sits in event loop.
+ * the address space stays loaded, so resuming the same process does not touch CR3
  * work(Process)
  */
 template <typename Work>
 void block(Work callback);
 
 /**
- * switches vmm, blocks the current active process, and calls
+ * blocks the current active process, and reschedules it
  */
 extern void yield();
 
+/**
+ * loads the core's kernel process, for when the core has nothing to do
+ * and should not keep an address space alive
+ */
+extern void release_address_space();
+
+/**
+ * ends the current thread because its process is exiting, never returns
+ */
+extern void leave_exiting_group();
+
+/**
+ * marks the current process blocked, an exiting group stops waiting for it
+ */
+extern void park(PCB& pcb);
+
 /**
  * switches to user mode with the given register state
  */
@@ -234,11 +430,6 @@ extern void user_mode(RegisterState* regs);
  */
 extern void handle_timer(RegisterState* regs);
 
-/**
- * syncs a barrier
- */
-extern void block_and_sync(Shared<Barrier>& trigger);
-
 /**
  * switches vmm, possibly yields the current active process, or returns the value,
  * depending on the flag status
@@ -296,15 +487,17 @@ inline RegisterState& RegisterState::operator=(RegisterState&& rhs) {
 
 // +++ ExitHandle
 
-inline ExitHandle::ExitHandle() : status() {}
+inline ExitHandle::ExitHandle() : status(), stats(Shared<MemStats>::make()) {}
 
-inline void ExitHandle::exit(int rc) {
+inline void ExitHandle::exit(int rc, const MemStats& final_stats) {
+    *stats = final_stats;
     status.set(rc);
 }
 
 inline void ExitHandle::wait(Process me) {
-    status.get([me](int rc) {
-        me.schedule([rc] {
+    status.get([me, stats = stats](int rc) {
+        me.schedule([rc, stats] {
+            PCB::current().children_mem_stats.add(*stats);
             PCB::current().regs.eax = rc;
         });
     });
@@ -336,7 +529,18 @@ inline PCB::PCB(RegisterState regs, RBTree<MMAPBlock*, NoLock>* mmap_tree) : reg
                                                                              children(Shared<ExitHandle>::NUL),
                                                                              sems(),
                                                                              working_directory(Shared<Node>::NUL),
-                                                                             user_files(),
+                                                                             files(Shared<FileTable>::make()),
+                                                                             in_use(),
+                                                                             parked(0),
+                                                                             mem_stats(),
+                                                                             children_mem_stats(),
+                                                                             populated_pdes(),
+                                                                             last_cpu(MAX_PROCS),
+                                                                             vruntime(0),
+                                                                             resumed_at(0),
+                                                                             nice(0),
+                                                                             affinity(0xffffffff),
+                                                                             group(),
                                                                              handler(nullptr),
                                                                              in_signal_handler(false) {}
 
@@ -354,13 +558,64 @@ inline void PCB::save_state(RegisterState* regs) {
 }
 
 inline void PCB::resume() {
+    if (!(group == Shared<ThreadGroup>::NUL) && group->exiting.get()) {
+        leave_exiting_group();
+    }
+    resumed_at = rdtsc();
     user_mode(&regs);
 }
 
+inline uint64_t PCB::weighted(uint64_t cycles) const {
+    // a process away for more than a few seconds does not need to be exact
+    if (cycles > 0xffffffff) {
+        cycles = 0xffffffff;
+    }
+    // nice 0 has a wmult of 2^22, so it is charged the cycles as they are
+    return (cycles * nice_to_wmult[nice - NICE_MIN]) >> 22;
+}
+
+inline void PCB::charge() {
+    uint64_t now = rdtsc();
+    vruntime += weighted(now - resumed_at);
+    resumed_at = now;
+}
+
+inline MemStats& PCB::stats() {
+    if (group == Shared<ThreadGroup>::NUL) {
+        return mem_stats;
+    }
+    return group->mem_stats;
+}
+
 inline PCB& PCB::current() {
     return *(PCB*)(VA_PROCESS);
 }
 
+// +++ ThreadGroup
+
+inline ThreadGroup::ThreadGroup(RBTree<MMAPBlock*, NoLock>* mmap_tree) : mmap_tree(mmap_tree), mem_stats(), members(), exits(), group_exit(), group_rc(0), group_stats(), waited(0) {}
+
+inline ThreadGroup::~ThreadGroup() {
+    // the last thread has been reaped
+    destroy_mmap_tree(mmap_tree);
+}
+
+// +++ AddressSpaceGuard
+
+inline AddressSpaceGuard::AddressSpaceGuard() : AddressSpaceGuard(PCB::current()) {}
+
+inline AddressSpaceGuard::AddressSpaceGuard(PCB& pcb) : group(pcb.group) {
+    if (!(group == Shared<ThreadGroup>::NUL)) {
+        group->lock.lock();
+    }
+}
+
+inline AddressSpaceGuard::~AddressSpaceGuard() {
+    if (!(group == Shared<ThreadGroup>::NUL)) {
+        group->lock.unlock();
+    }
+}
+
 // +++ Process
 
 inline Process::Process() : Process(PageNum::bad()) {}
@@ -368,8 +623,13 @@ inline Process::Process(PageDir pd) : pd(pd) {}
 
 template <typename Work>
 inline void Process::schedule(Work callback_before_resume) const {
-    go([me = *this, callback_before_resume] {
+    PCB& pcb = pcb_phys();
+    pcb.parked.set(0);
+    uint32_t core = pick_core(pcb);
+    go_ordered(core, queue_vruntime(pcb, core), allowed_cores(pcb), [me = *this, callback_before_resume] {
         Process::change(me);
+        // the balancer may have moved us next to a different set of vruntimes
+        PCB::current().vruntime = impl::dispatched_key();
         callback_before_resume();
         PCB::current().resume();
     });
@@ -401,16 +661,30 @@ inline Process Process::current() {
 }
 
 inline Process Process::change(Process process_to_switch_to) {
-    return exchange_cr3(process_to_switch_to.pd);
+    uint32_t me = SMP::me();
+
+    // another core may have changed the mappings since we last used it
+    if (process_to_switch_to.pd.ppn() == current_cr3().ppn() && PCB::current().last_cpu == me) {
+        return process_to_switch_to;
+    }
+
+    // published before CR3 is loaded, a TLB shootdown that misses it changed the page
+    // tables before we started caching them. writing CR3 serializes, so the store is out first
+    loaded_pd.mine() = process_to_switch_to.pd.ppn();
+    Process old = exchange_cr3(process_to_switch_to.pd);
+    PCB::current().last_cpu = me;
+    return old;
 }
 
 // ------------- interface
 
-// go back to kernel vmm, use scoping to deconstruct the process as this blocks
+// events run in whatever address space is loaded, use scoping to deconstruct the process as this blocks
 template <typename Work>
 void block(Work callback) {
     {
-        Process process = Process::change(default_kernel_per_core_process.mine());
+        Process process = Process::current();
+        PCB::current().charge();
+        park(PCB::current());
         callback(process);
     }
     event_loop();
@@ -11,9 +11,15 @@ class Queue {
     LockType lock;
 public:
     Queue() : first(nullptr), last(nullptr), lock() {}
+    explicit Queue(const char* lock_name) : first(nullptr), last(nullptr), lock(lock_name) {}
     Queue(const Queue&) = delete;
     Queue& operator=(Queue&) = delete;
 
+    // racy peek, only good as a hint
+    bool is_empty() const {
+        return first == nullptr;
+    }
+
     void monitor_add() {
         monitor((uintptr_t)&last);
     }
@@ -55,4 +61,100 @@ public:
     }
 };
 
+/**
+ * pass as the LockType to get a lock free Queue. adds never wait, so interrupt
+ * handlers can use it too. removes take turns, a remover waits for the one ahead
+ * of it to unlink its item, so nullptr always means the queue was empty
+ */
+struct LockFree {};
+
+template <typename T>
+class Queue<T, LockFree> {
+    Atomic<T*> incoming;        // newest first, adds push here
+    T * volatile outgoing;      // oldest first, only touched by the remover
+    Atomic<bool> removing;
+
+    static T* reverse(T* it) {
+        T* reversed = nullptr;
+        while (it != nullptr) {
+            T* next = it->next;
+            it->next = reversed;
+            reversed = it;
+            it = next;
+        }
+        return reversed;
+    }
+
+    // the other removers only hold us up for a few pointer moves, and a reverse
+    // of whatever was added since the last one
+    void start_removing() {
+        while (removing.exchange(true)) {
+            iAmStuckInALoop(false);
+        }
+    }
+
+public:
+    Queue() : incoming(nullptr), outgoing(nullptr), removing(false) {}
+    Queue(const Queue&) = delete;
+    Queue& operator=(Queue&) = delete;
+
+    // racy peek, but it never misses an item that was in the queue when it started.
+    // a remover is between taking incoming and filling outgoing only while removing
+    // is set, so removing is read last
+    bool is_empty() const {
+        return (T*)incoming == nullptr && outgoing == nullptr && !(bool)removing;
+    }
+
+    void monitor_add() {
+        incoming.monitor_value();
+    }
+
+    void monitor_remove() {
+        incoming.monitor_value();
+    }
+
+    void add(T* t) {
+        T* head = incoming.get();
+        do {
+            t->next = head;
+        } while (!incoming.compare_exchange(head, t));
+    }
+
+    T* remove() {
+        // a quick look first, so idle cores don't fight over an empty queue
+        if (is_empty()) {
+            return nullptr;
+        }
+        start_removing();
+        // take everything added so far in one go, in the order it was added
+        if (outgoing == nullptr) {
+            outgoing = reverse(incoming.exchange(nullptr));
+        }
+        T* it = outgoing;
+        if (it != nullptr) {
+            outgoing = it->next;
+        }
+        removing.set(false);
+        return it;
+    }
+
+    T* remove_all() {
+        start_removing();
+        T* it = outgoing;
+        T* rest = reverse(incoming.exchange(nullptr));
+        outgoing = nullptr;
+        removing.set(false);
+
+        if (it == nullptr) {
+            return rest;
+        }
+        T* last = it;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        last->next = rest;
+        return it;
+    }
+};
+
 #endif
@@ -0,0 +1,101 @@
+#include "rcu.h"
+
+#include "smp.h"
+
+namespace Rcu {
+
+// always odd, so 0 can mean a core that is idle or not up yet
+static Atomic<uint32_t> global_epoch{1};
+
+// the epoch each core last saw at a quiescent point
+static PerCPU<uint32_t> seen{};
+
+struct Retired {
+    uint32_t const epoch;
+    impl::Event* const e;
+    Retired* next = nullptr;
+    Retired(uint32_t const epoch, impl::Event* e) : epoch(epoch), e(e) {}
+};
+
+static SpinLock lock{};
+static Retired* first = nullptr;
+static Retired** last = &first;
+static Atomic<uint32_t> waiting{0};
+
+void retire(impl::Event* e) {
+    lock.lock();
+    // taking the epoch under the lock keeps the list in epoch order
+    Retired* r = new Retired(global_epoch.get(), e);
+    *last = r;
+    last = &r->next;
+    lock.unlock();
+    waiting.add_fetch(1);
+}
+
+// moves the epoch on once every core that is awake has seen the current one
+static bool try_advance() {
+    uint32_t now = global_epoch.get();
+    for (uint32_t i = 0; i < kConfig.totalProcs; i++) {
+        uint32_t s = __atomic_load_n(&seen.forCPU(i), __ATOMIC_ACQUIRE);
+        if (s != 0 && s != now) {
+            return false;
+        }
+    }
+    return global_epoch.compare_exchange(now, now + 2);
+}
+
+// hands over the work retired two epochs ago, every core has been quiescent since
+static void collect() {
+    uint32_t now = global_epoch.get();
+    Retired* done = nullptr;
+    Retired** done_tail = &done;
+
+    lock.lock();
+    while (first != nullptr && now - first->epoch >= 4) {
+        Retired* r = first;
+        first = r->next;
+        *done_tail = r;
+        done_tail = &r->next;
+    }
+    if (first == nullptr) {
+        last = &first;
+    }
+    *done_tail = nullptr;
+    lock.unlock();
+
+    while (done != nullptr) {
+        Retired* r = done;
+        done = r->next;
+        waiting.add_fetch(-1);
+        impl::make_ready(r->e);
+        delete r;
+    }
+}
+
+void note_quiescent() {
+    __atomic_store_n(&seen.mine(), global_epoch.get(), __ATOMIC_RELEASE);
+}
+
+void quiescent() {
+    note_quiescent();
+    if (waiting.get() == 0) {
+        return;
+    }
+    // we still hold nothing, so we can see the epoch we just moved to as well
+    if (try_advance()) {
+        note_quiescent();
+        try_advance();
+    }
+    collect();
+}
+
+void enter_idle() {
+    __atomic_store_n(&seen.mine(), 0, __ATOMIC_RELEASE);
+}
+
+void exit_idle() {
+    // has to be visible before we read anything published
+    __atomic_store_n(&seen.mine(), global_epoch.get(), __ATOMIC_SEQ_CST);
+}
+
+}  // namespace Rcu
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "stdint.h"
+#include "atomic.h"
+#include "events.h"
+
+// read-copy-update for data that is read far more often than it changes.
+// kernel code is never preempted, so a core that is back in the event loop,
+// asleep or in user mode can't be holding anything it read. readers just
+// read, writers publish a new version and defer freeing the old one until
+// every core has been through one of those points.
+// readers must not block while they hold on to what they read
+namespace Rcu {
+
+    // loads a published pointer, what it points at is fully visible
+    template <typename T>
+    inline T* read(T* const& p) {
+        return __atomic_load_n(&p, __ATOMIC_ACQUIRE);
+    }
+
+    // makes v visible to readers after everything written to it before
+    template <typename T>
+    inline void publish(T*& p, T* v) {
+        __atomic_store_n(&p, v, __ATOMIC_RELEASE);
+    }
+
+    extern void retire(impl::Event* e);
+
+    // runs the work once no reader can still see what was unpublished before the call
+    template <typename Work>
+    inline void defer(Work&& work) {
+        retire(impl::make_event(static_cast<Work&&>(work)));
+    }
+
+    // the event loop calls this between events, it also runs whatever is safe to run now
+    extern void quiescent();
+
+    // the same from an interrupt that came from user mode, it only takes note
+    extern void note_quiescent();
+
+    // around a core sleeping, so it doesn't hold everyone else up
+    extern void enter_idle();
+    extern void exit_idle();
+}
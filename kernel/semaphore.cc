@@ -8,8 +8,8 @@ void Semaphore::up() {
     auto e = waiting.remove();
     if (e != nullptr) {
         ASSERT(count == 0);
-        ready_queue.add(e);
         lock.unlock();
+        make_ready(e);
     } else {
         count += 1;
         lock.unlock();
@@ -19,14 +19,22 @@ public:
 
     void up();
 
+    // whether a down would go through right now. by the time the caller looks it may not
+    bool is_up() {
+        lock.lock();
+        bool up = count > 0;
+        lock.unlock();
+        return up;
+    }
+
     template <typename Work>
-    void down(const Work& work) {
-        auto e = new impl::EventWithWork(work);
+    void down(Work&& work) {
+        auto e = impl::make_event(static_cast<Work&&>(work));
         lock.lock();
         if (count > 0) {
             count --;
             lock.unlock();
-            impl::ready_queue.add(e);
+            impl::make_ready(e);
         } else {
             waiting.add(e);
             lock.unlock();
@@ -87,6 +87,10 @@ class Shared {
         return &ptr->data;
     }
 
+    inline T& operator*() const {
+        return ptr->data;
+    }
+
     inline bool operator==(Shared<T> const& rhs) {
         return ptr == rhs.ptr;
     }
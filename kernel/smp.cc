@@ -15,6 +15,8 @@ AtomicPtr<uint32_t> SMP::apit_divide;
 
 Atomic<uint32_t> SMP::running {0};
 
+CpuLocal SMP::locals[MAX_PROCS];
+
 const char* SMP::names[] = {
     "cpu0",
     "cpu1",
@@ -50,6 +52,12 @@ void SMP::init(bool isFirst) {
         // Register spurious interrupt handler
         IDT::interrupt(0xff, (uint32_t) spuriousHandler_);
 
+        // Register the wake IPI handler
+        IDT::interrupt(WAKE_VECTOR, (uint32_t) wakeHandler_);
+
+        // and the TLB shootdown one
+        IDT::interrupt(TLB_VECTOR, (uint32_t) tlbHandler_);
+
     }
 
     // disable PIC
@@ -61,4 +69,67 @@ void SMP::init(bool isFirst) {
     wrmsr(MSR, msr | ENABLE);
 
     spurious.set(0x1ff);
+
+    init_local();
+}
+
+void SMP::wake(uint32_t id) {
+    bool was_enabled = (getFlags() & 0x200) != 0;
+    cli();
+    ipi(id, WAKE_VECTOR);
+    if (was_enabled) sti();
+}
+
+// all the wake IPI has to do is get the core out of hlt
+extern "C" void wakeHandler() {
+    SMP::eoi();
+}
+
+// shootdowns asked of a core and the last one it has done
+struct TlbShootdowns {
+    Atomic<uint32_t> asked{0};
+    Atomic<uint32_t> done{0};
+};
+
+static PerCPU<TlbShootdowns> shootdowns{};
+
+void SMP::flush_tlb(uint32_t id) {
+    TlbShootdowns& it = shootdowns.forCPU(id);
+    uint32_t ticket = it.asked.add_fetch(1);
+
+    bool was_enabled = (getFlags() & 0x200) != 0;
+    cli();
+    ipi(id, TLB_VECTOR);
+    if (was_enabled) sti();
+
+    // another core may be waiting on us at the same time, so this spins with interrupts on
+    while ((int32_t)(it.done.get() - ticket) < 0) {
+        pause();
+    }
+}
+
+// reads what was asked before flushing, so everything asked up to there is covered
+extern "C" void tlbHandler() {
+    TlbShootdowns& it = shootdowns.mine();
+    uint32_t asked = it.asked.get();
+    vmm_on(getCR3());
+    it.done.set(asked);
+    SMP::eoi();
+}
+
+// kk in mbr.S builds CPU#0's early descriptor with this limit
+static_assert(sizeof(CpuLocal) == 64, "the per-CPU area is one cache line");
+
+void SMP::init_local() {
+    uint32_t me = lapic_id();
+    locals[me].id = me;
+
+    // a 32 bit ring 0 data segment covering just our area
+    uint32_t base = (uint32_t) &locals[me];
+    uint32_t limit = sizeof(CpuLocal) - 1;
+    uint32_t low = (base << 16) | (limit & 0xFFFF);
+    uint32_t high = (base & 0xFF000000) | 0x00409200 | (limit & 0x000F0000) | ((base >> 16) & 0xFF);
+    cpuLocalDescriptors[me] = ((uint64_t) high << 32) | low;
+
+    load_gs(cpuLocalDescriptorBase + me * 8);
 }
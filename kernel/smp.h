@@ -5,6 +5,13 @@
 #include "stdint.h"
 #include "atomic.h"
 
+/**
+ * the per-CPU area, %gs points at the copy of the running CPU
+ */
+struct alignas(CACHE_LINE) CpuLocal {
+    uint32_t id;  // must stay first, SMP::me() reads %gs:0
+};
+
 class SMP {
 private:
     static constexpr uint32_t ENABLE = 1 << 11;
@@ -22,9 +29,17 @@ public:
     static AtomicPtr<uint32_t> apit_current_count;
     static AtomicPtr<uint32_t> apit_divide;
     static const char* names[MAX_PROCS];
+    static CpuLocal locals[MAX_PROCS];
 public:
     static void init(bool isFirst);
-    static uint32_t me() { return (id.get() >> 24); }
+    static void init_local();
+    // reads the LAPIC, only for before init_local has run
+    static uint32_t lapic_id() { return (id.get() >> 24); }
+    static uint32_t me() {
+        uint32_t v;
+        asm volatile("mov %%gs:0, %0" : "=r"(v));
+        return v;
+    }
     static const char* name() { return names[me()]; }
     static void eoi() { eoi_reg = 0; }
 
@@ -35,16 +50,32 @@ public:
     }
 
     static Atomic<uint32_t> running;
+
+    // sent to a sleeping core when there is new work for it
+    static constexpr uint32_t WAKE_VECTOR = 41;
+
+    // sends the wake IPI without getting interleaved with other IPIs from this core
+    static void wake(uint32_t id);
+
+    // makes another core reload CR3, after page tables it may have cached changed
+    static constexpr uint32_t TLB_VECTOR = 42;
+
+    // has the core flush its TLB and waits until it has, interrupts must be on
+    static void flush_tlb(uint32_t id);
 };
 
 
+// each CPU gets its own cache line so neighbours don't false share
 template<class T>
 class PerCPU {
 private:
-    T data[MAX_PROCS];
+    struct alignas(CACHE_LINE) Slot {
+        T value;
+    };
+    Slot data[MAX_PROCS];
 public:
     inline T& forCPU(int id) {
-        return data[id];
+        return data[id].value;
     }
 
     inline T& mine() {
@@ -3,6 +3,7 @@
 #include "elf.h"
 #include "events.h"
 #include "filesystem.h"
+#include "futex.h"
 #include "idt.h"
 #include "libk.h"
 #include "machine.h"
@@ -211,6 +212,86 @@ int SYS::Call::handle_syscall(EAX eax, RegisterState* regs) {
             int fd = get_param<int>(user_esp, 0);
             return return_or_yield(dup(fd));
         }
+        case MEMSTATS: {
+            int who = get_param<int>(user_esp, 0);
+            MemStats* out = get_param<MemStats*>(user_esp, 1);
+            return return_or_yield(memstats(who, out));
+        }
+        case NICE: {
+            int inc = get_param<int>(user_esp, 0);
+            return return_or_yield(nice(inc));
+        }
+        case AFFINITY: {
+            uint32_t mask = get_param<uint32_t>(user_esp, 0);
+            return return_or_yield(affinity(mask));
+        }
+        case FUTEX_WAIT: {
+            int* addr = get_param<int*>(user_esp, 0);
+            int expected = get_param<int>(user_esp, 1);
+            return return_or_yield(futex_wait(addr, expected));
+        }
+        case FUTEX_WAKE: {
+            int* addr = get_param<int*>(user_esp, 0);
+            int n = get_param<int>(user_esp, 1);
+            return return_or_yield(futex_wake(addr, n));
+        }
+        case THREAD_CREATE: {
+            uint32_t eip = get_param<uint32_t>(user_esp, 0);
+            uint32_t esp = get_param<uint32_t>(user_esp, 1);
+            return return_or_yield(thread_create(eip, esp));
+        }
+        case THREAD_JOIN: {
+            int tid = get_param<int>(user_esp, 0);
+            thread_join(tid);
+            return -1;
+        }
+        case ISATTY: {
+            int fd = get_param<int>(user_esp, 0);
+            return return_or_yield(isatty(fd));
+        }
+        case READV: {
+            int fd = get_param<int>(user_esp, 0);
+            UserFileIO::IoVec* iov = get_param<UserFileIO::IoVec*>(user_esp, 1);
+            int count = get_param<int>(user_esp, 2);
+            return return_or_yield(readv(fd, iov, count));
+        }
+        case WRITEV: {
+            int fd = get_param<int>(user_esp, 0);
+            UserFileIO::IoVec* iov = get_param<UserFileIO::IoVec*>(user_esp, 1);
+            int count = get_param<int>(user_esp, 2);
+            return return_or_yield(writev(fd, iov, count));
+        }
+        case PREAD: {
+            int fd = get_param<int>(user_esp, 0);
+            void* buffer = get_param<void*>(user_esp, 1);
+            size_t len = get_param<size_t>(user_esp, 2);
+            uint32_t offset = get_param<uint32_t>(user_esp, 3);
+            return return_or_yield(pread(fd, buffer, len, offset));
+        }
+        case SEEK: {
+            int fd = get_param<int>(user_esp, 0);
+            int32_t offset = get_param<int32_t>(user_esp, 1);
+            int whence = get_param<int>(user_esp, 2);
+            return return_or_yield(seek(fd, offset, whence));
+        }
+        case SENDFILE: {
+            int out_fd = get_param<int>(user_esp, 0);
+            int in_fd = get_param<int>(user_esp, 1);
+            uint32_t* offset = get_param<uint32_t*>(user_esp, 2);
+            size_t count = get_param<size_t>(user_esp, 3);
+            return return_or_yield(sendfile(out_fd, in_fd, offset, count));
+        }
+        case POLL: {
+            UserFileIO::PollFd* fds = get_param<UserFileIO::PollFd*>(user_esp, 0);
+            int count = get_param<int>(user_esp, 1);
+            int timeout = get_param<int>(user_esp, 2);
+            return return_or_yield(poll(fds, count, timeout));
+        }
+        case NONBLOCK: {
+            int fd = get_param<int>(user_esp, 0);
+            int on = get_param<int>(user_esp, 1);
+            return return_or_yield(nonblock(fd, on));
+        }
         case GETCH:
         {
             return getChar(); 
@@ -232,8 +313,32 @@ void SYS::Call::exit(int rc) {
     using namespace ProcessManagement;
 
     block([rc](Process me) {
-        me.pcb_phys().exit_status->exit(rc);
+        // leave our stats behind for whoever joins us
+        PCB& pcb = me.pcb_phys();
+        MemStats final_stats{};
+        {
+            AddressSpaceGuard guard{pcb};
+            final_stats = user_mem_stats(pcb.mmap_tree, pcb.stats());
+        }
+        final_stats.add(pcb.children_mem_stats);
+
+        // the creator takes the other threads with it, whoever joins us waits for them all
+        Shared<ExitHandle> exit_status = pcb.exit_status;
+        Shared<ThreadGroup> group = pcb.group;
+        bool others_left = false;
+        if (!(group == Shared<ThreadGroup>::NUL)) {
+            LockGuard g{group->lock};
+            others_left = group->exit_all(me, exit_status, rc, final_stats);
+        }
+        if (!(group == Shared<ThreadGroup>::NUL) && group->exiting.get()) {
+            Futex::cancel(&*group);
+        }
+
+        // a thread leaves its group before whoever joins it gets to run
         Process::destroy(me);
+        if (!others_left) {
+            exit_status->exit(rc, final_stats);
+        }
     });
 }
 
@@ -241,6 +346,15 @@ int SYS::Call::fork() {
     using namespace VMM;
     using namespace ProcessManagement;
 
+    // the other threads would keep changing the memory under the copy
+    Shared<ThreadGroup> group = PCB::current().group;
+    if (!(group == Shared<ThreadGroup>::NUL)) {
+        LockGuard g{group->lock};
+        if (!group->alone(Process::current())) {
+            return -1;
+        }
+    }
+
     // save the state is in pcb for direct to transfer to the child
     // we are forking, so we should create a new child process
     // no need to save the registers because they should be copied through COW
@@ -254,9 +368,7 @@ int SYS::Call::fork() {
     PCB::current().children.add_left(child_pcb.exit_status);
 
     child_pcb.working_directory = PCB::current().working_directory;
-    for (uint32_t i = 0; i < 10; i++) {
-        child_pcb.user_files[i] = PCB::current().user_files[i];
-    }
+    child_pcb.files->copy_from(*PCB::current().files);
 
     // BUG need to copy the state stack??
 
@@ -297,6 +409,18 @@ int SYS::Call::execl(char* program_path, char** args) {
     using namespace VMM;
     using namespace ProcessManagement;
 
+    // the other threads would keep running in the old address space
+    // (scoped because we don't return from here on success)
+    {
+        Shared<ThreadGroup> group = PCB::current().group;
+        if (!(group == Shared<ThreadGroup>::NUL)) {
+            LockGuard g{group->lock};
+            if (!group->alone(Process::current())) {
+                return -1;
+            }
+        }
+    }
+
     // get program
     Shared<Node> program = FileSystem::find_by_path(PCB::current().working_directory, program_path);
     if (program == Shared<Node>()) {
@@ -325,9 +449,13 @@ int SYS::Call::execl(char* program_path, char** args) {
     old_pcb.children.transfer_left(PCB::current().children);
 
     PCB::current().working_directory = old_pcb.working_directory;
-    for (uint32_t i = 0; i < 10; i++) {
-        PCB::current().user_files[i] = old_pcb.user_files[i];
-    }
+    PCB::current().files = old_pcb.files;
+
+    // it is the same process as far as the scheduler cares
+    PCB::current().vruntime = old_pcb.vruntime;
+    PCB::current().resumed_at = old_pcb.resumed_at;
+    PCB::current().nice = old_pcb.nice;
+    PCB::current().affinity = old_pcb.affinity;
 
     Process::destroy(old_process);
 
@@ -416,20 +544,27 @@ void* SYS::Call::simple_mmap(void* addr, unsigned size, int fd, unsigned offset)
     mmap_flags = mmap_flags | Flags::MMAP_REAL | Flags::MMAP_RW | Flags::MMAP_USER;
 
     // check if we are mapping a file or not
-    if (fd == -1) {
-        return mmap(PCB::current().mmap_tree, va, length, mmap_flags, Shared<Node>::NUL, 0, 0);
-    } else {
-        if (!SYS::Helper::is_valid_fd(fd)) {
+    Shared<Node> node{};
+    if (fd != -1) {
+        OpenFile open_file = PCB::current().files->get(fd);
+        if (open_file.uf == Shared<UserFileContainer>::NUL) {
             return 0;
         }
 
         // BUG : need to check the type of the file
 
-        OpenFile open_file = PCB::current().user_files[fd];
-        Shared<Node> node = ((NodeFile*)(open_file.uf->ptr))->node;
+        node = ((NodeFile*)(open_file.uf->ptr))->node;
+    }
+
+    AddressSpaceGuard guard{};
+    void* mapped = mmap(PCB::current().mmap_tree, va, length, mmap_flags, node, fd == -1 ? 0 : file_offset, fd == -1 ? 0 : length);
 
-        return mmap(PCB::current().mmap_tree, va, length, mmap_flags, node, file_offset, length);
+    // the other threads have to fault the new pages into the same page tables
+    Shared<ThreadGroup> group = PCB::current().group;
+    if (mapped != 0 && !(group == Shared<ThreadGroup>::NUL)) {
+        group->share_page_tables(Process::current(), (VirtualAddress)mapped, (VirtualAddress)mapped + length);
     }
+    return mapped;
 }
 
 int SYS::Call::sigreturn() {
@@ -456,7 +591,8 @@ int SYS::Call::simple_munmap(void* addr) {
     if (!is_region_in_user_mem(va, va + 1)) {
         return -1;
     }
-    if (munmap_containing_block(PCB::current().mmap_tree, Process::current().pd, va)) {
+    AddressSpaceGuard guard{};
+    if (munmap_containing_block(PCB::current().mmap_tree, Process::current().pd, va, &PCB::current().stats())) {
         return 0;
     }
     return -1;
@@ -468,12 +604,7 @@ void SYS::Call::chdir(char* path) {
 }
 
 int SYS::Call::tui() {
-    int fd = SYS::Helper::get_next_fd();
-    if(fd == -1) {
-        return -1;
-    }
-    PCB::current().user_files[fd]= OpenFile(Shared<UserFileContainer>::make(new TUIFile()), Flags::USER_FILE_READ | Flags::USER_FILE_WRITE);
-    return fd;
+    return PCB::current().files->add(OpenFile(Shared<UserFileContainer>::make(new TUIFile()), Flags::USER_FILE_READ | Flags::USER_FILE_WRITE));
 }
 
 bool SYS::Call::set_tui(int tuifd) {
@@ -488,11 +619,6 @@ bool SYS::Call::set_tui(int tuifd) {
 
 // TODO: Implement the TextUI open part; how do we save as a node? Ctrl+S handler??
 int SYS::Call::open(const char* path) {
-    int fd = SYS::Helper::get_next_fd();
-    if (fd == -1) {
-        return -1;
-    }
-
     Shared<Node> cwd = PCB::current().working_directory;
 
     // search for the path
@@ -518,58 +644,163 @@ int SYS::Call::open(const char* path) {
         }
     }
 
-    PCB::current().user_files[fd] = OpenFile(Shared<UserFileContainer>::make(new NodeFile(node)),
-                                             Flags::USER_FILE_READ | Flags::USER_FILE_WRITE);
-
-    return fd;
+    return PCB::current().files->add(OpenFile(Shared<UserFileContainer>::make(new NodeFile(node)),
+                                              Flags::USER_FILE_READ | Flags::USER_FILE_WRITE));
 }
 
 int SYS::Call::close(int fd) {
-    if (!SYS::Helper::is_valid_fd(fd)) {
+    return PCB::current().files->close(fd) ? 0 : -1;
+}
+
+int SYS::Call::len(int fd) {
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr) {
         return -1;
     }
 
-    PCB::current().user_files[fd] = OpenFile();
+    int n = file->len();
+    SYS::Helper::done_with_fds();
+    return n;
+}
+
+ssize_t SYS::Call::read(int fd, void* buffer, size_t len) {
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr || !is_region_in_user_mem((VirtualAddress)buffer, (VirtualAddress)buffer + len)) {
+        return -1;
+    }
 
-    return 0;
+    ssize_t n = file->read(len, buffer);
+    SYS::Helper::done_with_fds();
+    return n;
 }
 
-int SYS::Call::len(int fd) {
-    if (!SYS::Helper::is_valid_fd(fd)) {
+ssize_t SYS::Call::write(int fd, void* buffer, size_t len) {
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr || !is_region_in_user_mem((VirtualAddress)buffer, (VirtualAddress)buffer + len)) {
         return -1;
     }
 
-    return PCB::current().user_files[fd].len();
+    ssize_t n = file->write(len, buffer);
+    SYS::Helper::done_with_fds();
+    return n;
 }
 
-ssize_t SYS::Call::read(int fd, void* buffer, size_t len) {
-    if (!SYS::Helper::is_valid_fd(fd)) {
+ssize_t SYS::Call::readv(int fd, UserFileIO::IoVec* iov, int count) {
+    // the file only ever sees our copy, the user's may change under us
+    UserFileIO::IoVec segs[SYS::Helper::IOV_MAX];
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr || !SYS::Helper::copy_iov(segs, iov, count)) {
         return -1;
     }
 
-    return PCB::current().user_files[fd].read(len, buffer);
+    ssize_t n = file->readv(segs, count);
+    SYS::Helper::done_with_fds();
+    return n;
 }
 
-ssize_t SYS::Call::write(int fd, void* buffer, size_t len) {
-    if (!SYS::Helper::is_valid_fd(fd)) {
+ssize_t SYS::Call::writev(int fd, UserFileIO::IoVec* iov, int count) {
+    // the file only ever sees our copy, the user's may change under us
+    UserFileIO::IoVec segs[SYS::Helper::IOV_MAX];
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr || !SYS::Helper::copy_iov(segs, iov, count)) {
         return -1;
     }
 
-    return PCB::current().user_files[fd].write(len, buffer);
+    ssize_t n = file->writev(segs, count);
+    SYS::Helper::done_with_fds();
+    return n;
 }
 
-int SYS::Call::pipe(int* write_fd, int* read_fd) {
-    int wfd = SYS::Helper::get_next_fd();
-    int rfd = SYS::Helper::get_next_fd(wfd);
+ssize_t SYS::Call::pread(int fd, void* buffer, size_t len, uint32_t offset) {
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr || !is_region_in_user_mem((VirtualAddress)buffer, (VirtualAddress)buffer + len)) {
+        return -1;
+    }
 
-    if (wfd == -1 || rfd == -1) {
+    ssize_t n = file->pread(len, buffer, offset);
+    SYS::Helper::done_with_fds();
+    return n;
+}
+
+int SYS::Call::seek(int fd, int32_t offset, int whence) {
+    OpenFile* file = SYS::Helper::use_fd(fd);
+    if (file == nullptr) {
         return -1;
     }
 
+    int n = file->seek(offset, whence);
+    SYS::Helper::done_with_fds();
+    return n;
+}
+
+ssize_t SYS::Call::sendfile(int out_fd, int in_fd, uint32_t* offset, size_t count) {
+    OpenFile* out = SYS::Helper::use_fd(out_fd, 0);
+    OpenFile* in = SYS::Helper::use_fd(in_fd, 1);
+    if (out == nullptr || in == nullptr) {
+        return -1;
+    }
+    if (offset != nullptr && !is_region_in_user_mem((VirtualAddress)offset, (VirtualAddress)(offset + 1))) {
+        return -1;
+    }
+
+    ssize_t n = in->send(*out, count, offset);
+    SYS::Helper::done_with_fds();
+    return n;
+}
+
+int SYS::Call::poll(UserFileIO::PollFd* fds, int count, int timeout) {
+    using namespace UserFileIO;
+
+    // with nothing to watch it is just a sleep
+    if (count < 0 || count > SYS::Helper::POLL_MAX ||
+        (count > 0 && !is_region_in_user_mem((VirtualAddress)fds, (VirtualAddress)(fds + count)))) {
+        return -1;
+    }
+
+    // our own copies, the files stay open for the poll even if they get closed
+    OpenFile* files = new OpenFile[count];
+    PollFd* kfds = new PollFd[count];
+    for (int i = 0; i < count; i++) {
+        kfds[i] = fds[i];
+        files[i] = PCB::current().files->get(kfds[i].fd);
+    }
+
+    uint32_t n = poll_scan(files, kfds, count);
+    if (n > 0 || timeout == 0) {
+        for (int i = 0; i < count; i++) {
+            fds[i].revents = kfds[i].revents;
+        }
+        delete[] files;
+        delete[] kfds;
+        return n;
+    }
+
+    PCB::current().regs.eax = 0;
+    block([fds, files, kfds, count, timeout](Process me) {
+        Poll::start(me, fds, files, kfds, count, timeout);
+    });
+
+    // it should never return
+    return -2;
+}
+
+int SYS::Call::nonblock(int fd, int on) {
+    // it goes with the descriptor, a dup of it still waits
+    return PCB::current().files->set_perms(fd, Flags::USER_FILE_NONBLOCK, on) ? 0 : -1;
+}
+
+int SYS::Call::pipe(int* write_fd, int* read_fd) {
     Shared<UserFileContainer> pipe = Shared<UserFileContainer>::make(new PipeFile());
 
-    PCB::current().user_files[wfd] = OpenFile(pipe, Flags::USER_FILE_WRITE);
-    PCB::current().user_files[rfd] = OpenFile(pipe, Flags::USER_FILE_READ);
+    int wfd = PCB::current().files->add(OpenFile(pipe, Flags::USER_FILE_WRITE));
+    if (wfd == -1) {
+        return -1;
+    }
+    int rfd = PCB::current().files->add(OpenFile(pipe, Flags::USER_FILE_READ), wfd);
+    if (rfd == -1) {
+        PCB::current().files->close(wfd);
+        return -1;
+    }
 
     *write_fd = wfd;
     *read_fd = rfd;
@@ -578,20 +809,184 @@ int SYS::Call::pipe(int* write_fd, int* read_fd) {
 }
 
 int SYS::Call::dup(int fd) {
-    if (!SYS::Helper::is_valid_fd(fd)) {
+    return PCB::current().files->dup(fd);
+}
+
+int SYS::Call::isatty(int fd) {
+    OpenFile file = PCB::current().files->get(fd);
+    if (file.uf == Shared<UserFileContainer>::NUL) {
+        return -1;
+    }
+
+    // what user stdio line buffers, everything else waits for a full buffer
+    auto type = file.type();
+    return type == UserFileIO::TERMINAL || type == UserFileIO::TUI ? 1 : 0;
+}
+
+int SYS::Call::memstats(int who, MemStats* out) {
+    if (!is_region_in_user_mem((VirtualAddress)out, (VirtualAddress)(out + 1))) {
         return -1;
     }
 
-    // search for a new place
-    int new_fd = SYS::Helper::get_next_fd();
-    if (new_fd == -1) {
+    if (who == SYS::Helper::MEMSTATS_SELF) {
+        // the other threads fault into the same counters and tree
+        MemStats stats{};
+        {
+            AddressSpaceGuard guard{};
+            stats = user_mem_stats(PCB::current().mmap_tree, PCB::current().stats());
+        }
+        *out = stats;
+        return 0;
+    }
+
+    if (who == SYS::Helper::MEMSTATS_CHILDREN) {
+        *out = PCB::current().children_mem_stats;
+        return 0;
+    }
+
+    return -1;
+}
+
+int SYS::Call::nice(int inc) {
+    using namespace ProcessManagement;
+
+    // clamp instead of failing, like unix. the whole range is 40 levels
+    if (inc < -40) {
+        inc = -40;
+    } else if (inc > 40) {
+        inc = 40;
+    }
+    int level = PCB::current().nice + inc;
+    if (level < NICE_MIN) {
+        level = NICE_MIN;
+    } else if (level > NICE_MAX) {
+        level = NICE_MAX;
+    }
+    PCB::current().nice = level;
+    return level;
+}
+
+int SYS::Call::affinity(uint32_t mask) {
+    using namespace ProcessManagement;
+
+    int old = (int)allowed_cores(PCB::current());
+
+    // 0 just asks
+    if (mask == 0) {
+        return old;
+    }
+
+    uint32_t all = kConfig.totalProcs >= 32 ? 0xffffffff : (1 << kConfig.totalProcs) - 1;
+    if ((mask & all) == 0) {
         return -1;
     }
+    PCB::current().affinity = mask & all;
+
+    // move on the way out if we can't stay here
+    if ((mask & (1 << SMP::me())) == 0) {
+        preempt_flag.mine() = true;
+    }
+    return old;
+}
+
+// where the futex word lives, 0 if the process can't use it
+static PhysicalAddress futex_key(int* addr) {
+    AddressSpaceGuard guard{};
+    return user_word_address(PCB::current().mmap_tree, Process::current().pd, (VirtualAddress)addr,
+                             &PCB::current().stats(), &PCB::current().populated_pdes);
+}
+
+int SYS::Call::futex_wait(int* addr, int expected) {
+    using namespace ProcessManagement;
 
-    // copy the fd
-    PCB::current().user_files[new_fd] = PCB::current().user_files[fd];
+    PhysicalAddress key = futex_key(addr);
+    if (key == 0) {
+        return -1;
+    }
 
-    return new_fd;
+    // the value may change before we get to look, in which case the caller should retry
+    PCB::current().regs.eax = 0;
+    block([key, expected](Process me) {
+        // an exiting group cancels its threads' waits, so they get to leave
+        Shared<ThreadGroup> group = me.pcb_phys().group;
+        bool queued = Futex::wait(key, expected, [me] {
+            me.schedule();
+        }, group == Shared<ThreadGroup>::NUL ? nullptr : &*group);
+        if (!queued) {
+            me.schedule([] {
+                PCB::current().regs.eax = 1;
+            });
+        }
+    });
+    return -1;
+}
+
+int SYS::Call::futex_wake(int* addr, int n) {
+    using namespace ProcessManagement;
+
+    PhysicalAddress key = futex_key(addr);
+    if (key == 0 || n < 0) {
+        return -1;
+    }
+    return Futex::wake(key, n);
+}
+
+int SYS::Call::thread_create(uint32_t eip, uint32_t esp) {
+    using namespace ProcessManagement;
+
+    if (!is_region_in_user_mem(eip, eip + 1) || !is_region_in_user_mem(esp - 4, esp)) {
+        return -1;
+    }
+
+    // the first thread turns the process into a group of one
+    if (PCB::current().group == Shared<ThreadGroup>::NUL) {
+        Shared<ThreadGroup> group = Shared<ThreadGroup>::make(PCB::current().mmap_tree);
+        group->add(Process::current(), Shared<ExitHandle>::NUL);
+        group->mem_stats = PCB::current().mem_stats;
+        PCB::current().group = group;
+    }
+
+    Shared<ThreadGroup> group = PCB::current().group;
+    Process thread{};
+    int tid;
+    {
+        LockGuard g{group->lock};
+        if (group->exiting.get()) {
+            return -1;
+        }
+        thread = Process::create_thread(Process::current(), eip, esp);
+        tid = group->add(thread, thread.pcb_phys().exit_status);
+    }
+
+    if (tid < 0) {
+        Process::destroy(thread);
+        return -1;
+    }
+
+    thread.schedule();
+    return tid;
+}
+
+void SYS::Call::thread_join(int tid) {
+    using namespace ProcessManagement;
+
+    block([tid](Process me) {
+        Shared<ThreadGroup> group = me.pcb_phys().group;
+        Shared<ExitHandle> thread_handle{};
+        if (!(group == Shared<ThreadGroup>::NUL)) {
+            LockGuard g{group->lock};
+            thread_handle = group->take_exit(tid);
+        }
+
+        // not a thread of ours or someone joined it already
+        if (thread_handle == Shared<ExitHandle>::NUL) {
+            me.schedule([]() {
+                PCB::current().regs.eax = -1;
+            });
+        } else {
+            thread_handle->wait(me);
+        }
+    });
 }
 
 // =================================================================
@@ -681,16 +1076,39 @@ bool SYS::Helper::try_user_exception_handler(int type, unsigned arg) {
     return false;
 }
 
-int SYS::Helper::get_next_fd(int after) {
-    // search for a new place
-    for (int fd = K::max(0, after) + 1; fd < 10; fd++) {
-        if (!is_valid_fd(fd)) {
-            return fd;
-        }
-    }
-    return -1;
+bool SYS::Helper::is_valid_fd(int fd) {
+    return PCB::current().files->get(fd).uf != Shared<UserFileContainer>::NUL;
 }
 
-bool SYS::Helper::is_valid_fd(int fd) {
-    return fd >= 0 && fd < 10 && PCB::current().user_files[fd].uf != Shared<UserFileContainer>::NUL;
+UserFileIO::OpenFile* SYS::Helper::use_fd(int fd, int slot) {
+    UserFileIO::OpenFile& file = PCB::current().in_use[slot];
+    file = PCB::current().files->get(fd);
+    return file.uf == Shared<UserFileContainer>::NUL ? nullptr : &file;
+}
+
+void SYS::Helper::done_with_fds() {
+    PCB::current().in_use[0] = UserFileIO::OpenFile();
+    PCB::current().in_use[1] = UserFileIO::OpenFile();
+}
+
+bool SYS::Helper::copy_iov(UserFileIO::IoVec* to, UserFileIO::IoVec* iov, int count) {
+    if (count <= 0 || count > IOV_MAX) {
+        return false;
+    }
+    if (!is_region_in_user_mem((VirtualAddress)iov, (VirtualAddress)(iov + count))) {
+        return false;
+    }
+    memcpy(to, iov, count * sizeof(UserFileIO::IoVec));
+
+    // the total has to fit in what we return
+    uint32_t total = 0;
+    for (int i = 0; i < count; i++) {
+        VirtualAddress base = (VirtualAddress)to[i].base;
+        uint32_t len = to[i].len;
+        if (len > 0x7fffffff - total || !is_region_in_user_mem(base, base + len)) {
+            return false;
+        }
+        total += len;
+    }
+    return true;
 }
@@ -1,6 +1,7 @@
 #ifndef _SYS_H_
 #define _SYS_H_
 
+#include "poll.h"
 #include "process.h"
 #include "stdint.h"
 
@@ -40,6 +41,21 @@ class SYS {
             WRITE2 = 1025,
             PIPE = 1026,
             DUP = 1028,
+            MEMSTATS = 1030,
+            NICE = 1031,
+            AFFINITY = 1032,
+            FUTEX_WAIT = 1033,
+            FUTEX_WAKE = 1034,
+            THREAD_CREATE = 1035,
+            THREAD_JOIN = 1036,
+            ISATTY = 1037,
+            READV = 1038,
+            WRITEV = 1039,
+            PREAD = 1040,
+            SEEK = 1041,
+            SENDFILE = 1042,
+            POLL = 1043,
+            NONBLOCK = 1044,
             GETCH = 1100,
             TUI  = 1101,
             SET_TUI = 1102
@@ -72,6 +88,21 @@ class SYS {
         static ssize_t write(int fd, void* buffer, size_t len);                        // 1 or 1025
         static int pipe(int* write_fd, int* read_fd);                                  // 1026
         static int dup(int fd);
+        static int memstats(int who, MemStats* out);                                   // 1030
+        static int nice(int inc);                                                      // 1031
+        static int affinity(uint32_t mask);                                            // 1032
+        static int futex_wait(int* addr, int expected);                                // 1033
+        static int futex_wake(int* addr, int n);                                       // 1034
+        static int thread_create(uint32_t eip, uint32_t esp);                          // 1035
+        static void thread_join(int tid);                                              // 1036
+        static int isatty(int fd);                                                     // 1037
+        static ssize_t readv(int fd, UserFileIO::IoVec* iov, int count);               // 1038
+        static ssize_t writev(int fd, UserFileIO::IoVec* iov, int count);              // 1039
+        static ssize_t pread(int fd, void* buffer, size_t len, uint32_t offset);       // 1040
+        static int seek(int fd, int32_t offset, int whence);                          // 1041
+        static ssize_t sendfile(int out_fd, int in_fd, uint32_t* offset, size_t count); // 1042
+        static int poll(UserFileIO::PollFd* fds, int count, int timeout);              // 1043
+        static int nonblock(int fd, int on);                                           // 1044
         static char getch();
         static int tui();
         static bool set_tui(int tui_id);
@@ -84,6 +115,10 @@ class SYS {
 
         static constexpr VirtualAddress VA_IMPLICIT_SIGRET = 3;
 
+        // who to report memory stats for
+        static constexpr int MEMSTATS_SELF = 0;
+        static constexpr int MEMSTATS_CHILDREN = 1;
+
         /**
          * tries to allow the current user process to handle the exception
          * assumes the user state is already saved in the current pcb
@@ -91,15 +126,33 @@ class SYS {
         static bool try_user_exception_handler(int type, unsigned arg);
 
         /**
-         * searches for a free file descriptor that is > than the given one
-         * for the current process
+         * checks if the given fd is valid for the current process
          */
-        static int get_next_fd(int after = -1);
+        static bool is_valid_fd(int fd);
 
         /**
-         * checks if the given fd is valid for the current process
+         * copies the open file at fd into slot of the current thread's in_use, where it
+         * stays open through the call even if another thread closes fd. null if fd is not open
          */
-        static bool is_valid_fd(int fd);
+        static UserFileIO::OpenFile* use_fd(int fd, int slot = 0);
+
+        /**
+         * lets go of what use_fd kept, for a call that did not block. a blocked one
+         * holds on until the thread's next call
+         */
+        static void done_with_fds();
+
+        // the most segments a readv or writev takes
+        static constexpr int IOV_MAX = 64;
+
+        /**
+         * copies the user's iovec array into to, which has room for IOV_MAX, and checks
+         * that the array and every segment the copy names are in user memory
+         */
+        static bool copy_iov(UserFileIO::IoVec* to, UserFileIO::IoVec* iov, int count);
+
+        // the most entries a poll takes
+        static constexpr int POLL_MAX = 64;
 
         // NOTE : maybe template the valid desc cuz we use this for other descs ??
     };
@@ -7,6 +7,7 @@ namespace TextUI {
 
     Render::Render() {
         x = y = 0;
+        cursor_pos = -1;
         display = (uint16_t*) 0xB8000;
         forecolor = 0x0F; 
         backcolor = 0x00;
@@ -359,6 +360,11 @@ namespace TextUI {
     {
         // Debug::printf("Updating cursor to %d, %d\n", x, y);
         uint16_t pos = y * 80 + x;
+        // port writes are slow, skip them if nothing moved
+        if (pos == cursor_pos) {
+            return;
+        }
+        cursor_pos = pos;
         outb(0x3D4, 0x0F);
         outb(0x3D5, (uint8_t) (pos & 0xFF));
         outb(0x3D4, 0x0E);
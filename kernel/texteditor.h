@@ -22,6 +22,7 @@ namespace TextUI {
         uint16_t *display;
         char forecolor, backcolor;
         int x, y;
+        int cursor_pos;  // where the hardware cursor was last put
         vector<vector<letter *> *> *buffer;
         bool first_line;
         public:
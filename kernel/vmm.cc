@@ -16,12 +16,12 @@ namespace SmartPMM
     const PageEntry PageEntry::NUL = PageEntry(PageNum::BAD_NUM, 0);
 
     PageRefCount *physical_page_reference_counts;
-    SpinLock *physical_page_locks;
+    TasLock *physical_page_locks;
 
     void init_smart_pmm()
     {
         physical_page_reference_counts = new PageRefCount[page_num(page_up(kConfig.memSize))];
-        physical_page_locks = new SpinLock[page_num(page_up(kConfig.memSize))];
+        physical_page_locks = new TasLock[page_num(page_up(kConfig.memSize))];
     }
 
 } // namespace SmartPMM
@@ -80,7 +80,7 @@ namespace SmartVMM
             return mmap_tree->search(vpn, CompareFunction<PageNum, MMAPBlock *>());
         }
 
-        PageTable ensure_writeable_pt(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, PageNum vpn)
+        PageTable ensure_writeable_pt(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, PageNum vpn, MemStats *stats, PdeBitmap *populated)
         {
             PageEntry &pde = pd[vpn.pdi()];
 
@@ -89,6 +89,10 @@ namespace SmartVMM
             {
                 SmartPhysPage<PageEntry> new_pt_page = get_smart_page<PageEntry>();
                 pde.smart_set(PageEntry(new_pt_page.ppn(), Flags::ALL));
+                if (populated != nullptr)
+                {
+                    populated->set(vpn.pdi());
+                }
             }
 
             // if the PT was there, but it was read only, we have a COW case
@@ -101,13 +105,21 @@ namespace SmartVMM
                 SmartPhysPage<PageEntry> new_pt_page = get_smart_page<PageEntry>();
 
                 // reset the entry and copy it if we can't claim it
-                pde.smart_set(PageEntry::NUL, [&pt, &new_pt_page, mmap_tree, vpn](PageNum ppn, uint32_t ref)
+                pde.smart_set(PageEntry::NUL, [&pt, &new_pt_page, mmap_tree, vpn, stats](PageNum ppn, uint32_t ref)
                               {
             if (ref > 0) {
+                if (stats != nullptr) {
+                    stats->pt_copies++;
+                }
+
                 // we need to copy the original one and add the references
                 PageTable og_pt = pt;
                 pt = new_pt_page.ppn();
                 foreach_allocated_vpn(mmap_tree, vpn.pdi() * ENTRIES_PER_PAGE, ENTRIES_PER_PAGE, 0, 0, [&pt, &og_pt](PageNum pn, MMAPBlock* block) {
+                    // never faulted in, so there is nothing to share
+                    if (og_pt[pn.pti()].flags().is_not(Flags::PRESENT)) {
+                        return 1;
+                    }
                     if (block->flags.is(Flags::MMAP_REAL)) {
                         pt[pn.pti()].smart_set(og_pt[pn.pti()]);
                     } else {
@@ -133,7 +145,7 @@ namespace SmartVMM
             return pde.ppn();
         }
 
-        PhysPage<char> ensure_data(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageTable pt, PageNum vpn, bool writeable)
+        PhysPage<char> ensure_data(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageTable pt, PageNum vpn, bool writeable, MemStats *stats)
         {
             PageEntry &pte = pt[vpn.pti()];
 
@@ -147,6 +159,7 @@ namespace SmartVMM
                 // initlaize to zero mpaping
                 SmartPhysPage<char> new_ro_data_page = BadPageCache::zero_page;
                 Flags flags_to_remove = Flags::READ_WRITE;
+                bool loaded = false;
 
                 // check if this is a file mapping and that we need to load from it
                 if (block->file != Shared<Node>::NUL)
@@ -164,7 +177,7 @@ namespace SmartVMM
                             (block->flags.is_not(Flags::MMAP_F_TRUNC) || mapped_page_idx < page_num(mapped_bytes)))
                         {
                             ASSERT(page_down(block->file_offset) == block->file_offset);
-                            new_ro_data_page = BadPageCache::get_ro_file_page(block->file, page_num(block->file_offset) + mapped_page_idx);
+                            new_ro_data_page = BadPageCache::get_ro_file_page(block->file, page_num(block->file_offset) + mapped_page_idx, &loaded);
                         }
 
                         // if we need a partial paghe, then everything has to be read into a new page
@@ -176,10 +189,31 @@ namespace SmartVMM
                                                    block->file_offset + mapped_page_idx.to_address(), len,
                                                    (char *)new_ro_data_page.address());
                             flags_to_remove = 0;
+                            loaded = true;
                         }
                     }
                 }
 
+                if (stats != nullptr)
+                {
+                    if (block->flags.is(Flags::MMAP_REAL | Flags::MMAP_USER))
+                    {
+                        stats->resident_pages++;
+                    }
+                    if (new_ro_data_page.ppn() == BadPageCache::zero_page.ppn())
+                    {
+                        stats->zero_page_maps++;
+                    }
+                    else
+                    {
+                        stats->file_faults++;
+                    }
+                    if (loaded)
+                    {
+                        stats->major_faults++;
+                    }
+                }
+
                 Flags pe_flags = (block->compute_page_entry_flags() - flags_to_remove) | Flags::PRESENT;
 
                 // save the data into the pte. this is safe because we just got a new process
@@ -191,6 +225,11 @@ namespace SmartVMM
             // if the data page was there, but it was read only, we have a COW case
             if (writeable && pte.flags().is_not(Flags::READ_WRITE))
             {
+                if (stats != nullptr)
+                {
+                    stats->cow_breaks++;
+                }
+
                 // get a place holder for the og_data
                 PhysPage<char> data = pte.ppn();
 
@@ -216,7 +255,7 @@ namespace SmartVMM
             return pte.ppn();
         }
 
-        bool remove_mapping(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, PageNum vpn, MMAPBlock *containing_mmap_block)
+        bool remove_mapping(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, PageNum vpn, MMAPBlock *containing_mmap_block, MemStats *stats, PageNum *dropped)
         {
             PageEntry &pde = pd[vpn.pdi()];
             if (pde.flags().is_not(Flags::PRESENT))
@@ -231,15 +270,25 @@ namespace SmartVMM
             }
 
             // remove the mapping
-            pt = ensure_writeable_pt(mmap_tree, pd, vpn);
+            pt = ensure_writeable_pt(mmap_tree, pd, vpn, stats);
             if (containing_mmap_block->compute_page_entry_flags().is(Flags::MMAP_REAL))
             {
-                pt[vpn.pti()].smart_set(PageEntry::NUL);
+                pt[vpn.pti()].smart_set(PageEntry::NUL, [dropped](PageNum ppn, uint32_t refs)
+                                        {
+            if (refs == 0 && dropped != nullptr) {
+                *dropped = ppn;
+                return false;
+            }
+            return true; });
             }
             else
             {
                 pt[vpn.pti()].fake_set(PageEntry::NUL);
             }
+            if (stats != nullptr && containing_mmap_block->flags.is(Flags::MMAP_REAL | Flags::MMAP_USER))
+            {
+                stats->resident_pages--;
+            }
             return true;
         }
 
@@ -260,22 +309,88 @@ namespace SmartVMM
         delete mmap_tree;
     }
 
-    PageDir create_page_dir_like(PageDir pd_to_copy)
+    PageDir create_page_dir_like(PageDir pd_to_copy, const PdeBitmap *populated)
     {
-        // mark the cow flags
-        for (uint32_t pdi = 0; pdi < ENTRIES_PER_PAGE; pdi++)
+        // without a bitmap we have to find the page tables ourselves
+        PdeBitmap scanned{};
+        if (populated == nullptr)
         {
-            pd_to_copy[pdi].smart_set(PageEntry(pd_to_copy[pdi].ppn(), pd_to_copy[pdi].flags() - Flags::READ_WRITE));
+            scanned = PdeBitmap::of(pd_to_copy);
+            populated = &scanned;
         }
 
-        // make a copy of the pd
+        // the new pd starts out zeroed, so only the page tables need to be shared
         PageDir pd = get_smart_page<PageEntry>();
-        for (uint32_t pdi = 0; pdi < ENTRIES_PER_PAGE; pdi++)
+        populated->foreach_set([&pd_to_copy, &pd](uint32_t pdi)
+                               {
+            PageEntry& pde = pd_to_copy[pdi];
+            if (pde.flags().is_not(Flags::PRESENT)) {
+                return;
+            }
+
+            // mark the cow flags and share the pt
+            pde.smart_set(PageEntry(pde.ppn(), pde.flags() - Flags::READ_WRITE));
+            pd[pdi].smart_set(pde); });
+
+        if (current_cr3().ppn() == pd_to_copy.ppn())
+        {
+            vmm_on(getCR3());
+        }
+
+        return pd;
+    }
+
+    void populate_page_tables(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress start, VirtualAddress end, PdeBitmap *populated)
+    {
+        PageNum first = page_num(start);
+        foreach_allocated_vpn(mmap_tree, first, page_num(end) - first, 0, 0, [mmap_tree, &pd, populated](PageNum vpn, MMAPBlock *block)
+                              {
+            ensure_writeable_pt(mmap_tree, pd, vpn, nullptr, populated);
+            // one per page table is enough
+            return ENTRIES_PER_PAGE - vpn.pti(); });
+
+        if (current_cr3().ppn() == pd.ppn())
         {
-            pd[pdi].smart_set(pd_to_copy[pdi]);
+            vmm_on(getCR3());
         }
+    }
 
-        if (current_cr3().ppn() == pd_to_copy.ppn())
+    void map_kernel_frame(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va, PhysicalAddress pa, Flags flags, PdeBitmap *populated)
+    {
+        PageNum vpn = page_num(va);
+        MMAPBlock *block = Helper::containing_block(mmap_tree, vpn);
+        ASSERT(block != nullptr && block->flags.is_not(Flags::MMAP_REAL));
+
+        PageTable pt = ensure_writeable_pt(mmap_tree, pd, vpn, nullptr, populated);
+        pt[vpn.pti()].fake_set(PageEntry(page_num(pa), flags | Flags::PRESENT));
+
+        if (current_cr3().ppn() == pd.ppn())
+        {
+            invlpg(va);
+        }
+    }
+
+    PageDir create_thread_page_dir(PageDir pd_to_share, VirtualAddress start, VirtualAddress end, const PdeBitmap *populated)
+    {
+        uint32_t first_shared = page_num(start).pdi();
+        uint32_t last_shared = page_num(end - 1).pdi();
+
+        PageDir pd = get_smart_page<PageEntry>();
+        populated->foreach_set([&pd_to_share, &pd, first_shared, last_shared](uint32_t pdi)
+                               {
+            PageEntry& pde = pd_to_share[pdi];
+            if (pde.flags().is_not(Flags::PRESENT)) {
+                return;
+            }
+
+            // a read only one is still COW shared with someone outside the threads, so it stays COW
+            bool shared = pdi >= first_shared && pdi <= last_shared && pde.flags().is(Flags::READ_WRITE);
+            if (!shared) {
+                pde.smart_set(PageEntry(pde.ppn(), pde.flags() - Flags::READ_WRITE));
+            }
+            pd[pdi].smart_set(pde); });
+
+        if (current_cr3().ppn() == pd_to_share.ppn())
         {
             vmm_on(getCR3());
         }
@@ -285,23 +400,32 @@ namespace SmartVMM
 
     void destroy_page_dir(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd)
     {
+        // frames that drop to zero references are collected and freed together
+        PhysMem::FrameBatch freed{};
+
         // lets unref all the page tables atomically
         for (uint32_t pdi = 0; pdi < ENTRIES_PER_PAGE; pdi++)
         {
             PageEntry &pde = pd[pdi];
 
-            pde.smart_set(PageEntry::NUL, [mmap_tree, pdi](PageNum ppn, uint32_t refs)
+            pde.smart_set(PageEntry::NUL, [mmap_tree, pdi, &freed](PageNum ppn, uint32_t refs)
                           {
             // unref all the real data pages ONLY IF THIS IS LAST REFERENCE
             if (refs == 0) {
                 PageTable pt = ppn;
-                foreach_allocated_vpn(mmap_tree, pdi * ENTRIES_PER_PAGE, ENTRIES_PER_PAGE, Flags::MMAP_REAL, 0, [&pt](PageNum pn, MMAPBlock* block) {
-                    pt[pn.pti()].smart_set(PageEntry::NUL);
+                foreach_allocated_vpn(mmap_tree, pdi * ENTRIES_PER_PAGE, ENTRIES_PER_PAGE, Flags::MMAP_REAL, 0, [&pt, &freed](PageNum pn, MMAPBlock* block) {
+                    pt[pn.pti()].smart_set(PageEntry::NUL, [&freed](PageNum data_ppn, uint32_t data_refs) {
+                        if (data_refs == 0) {
+                            freed.add(data_ppn.to_address());
+                        }
+                        return false;
+                    });
                     return 1;
                 });
+                freed.add(ppn.to_address());
             }
 
-            return true; });
+            return false; });
         }
 
         // no need to unref the PD as it is ref counted
@@ -405,13 +529,38 @@ namespace SmartVMM
         return (void *)0;
     }
 
-    bool munmap_containing_block(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va)
+    // how many frames munmap holds back at a time while it waits for the other cores
+    static constexpr uint32_t UNMAP_BATCH = 64;
+
+    bool munmap_containing_block(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va, MemStats *stats)
     {
         MMAPBlock *containing_allocated_block = mmap_tree->remove(page_num(va), CompareFunction<PageNum, MMAPBlock *>());
         if (containing_allocated_block == nullptr)
         {
             return false;
         }
+        // the other threads' cores may still reach the frames through their TLBs,
+        // so the frames are held back until every core has flushed
+        PageNum dropped[UNMAP_BATCH];
+        uint32_t count = 0;
+        auto flush = [&dropped, &count, pd]
+        {
+            if (pd.ppn() == Process::current().pd.ppn())
+            {
+                vmm_on(getCR3());
+                Shared<ThreadGroup> group = PCB::current().group;
+                if (!(group == Shared<ThreadGroup>::NUL))
+                {
+                    group->flush_other_tlbs();
+                }
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                PhysMem::dealloc_frame(dropped[i].to_address());
+            }
+            count = 0;
+        };
+
         for (PageNum vpn = containing_allocated_block->start;
              vpn < containing_allocated_block->start + containing_allocated_block->size;)
         {
@@ -419,32 +568,90 @@ namespace SmartVMM
             {
                 vpn += ENTRIES_PER_PAGE;
             }
-            Helper::remove_mapping(mmap_tree, pd, vpn, containing_allocated_block);
+            PageNum ppn = PageNum::bad();
+            Helper::remove_mapping(mmap_tree, pd, vpn, containing_allocated_block, stats, &ppn);
+            if (ppn != PageNum::bad())
+            {
+                dropped[count++] = ppn;
+                if (count == UNMAP_BATCH)
+                {
+                    flush();
+                }
+            }
             vpn++;
         }
-        if (pd.ppn() == Process::current().pd.ppn())
-        {
-            vmm_on(getCR3());
-        }
+        flush();
         delete containing_allocated_block;
         return true;
     }
 
-    bool handle_page_fault(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va, bool write_fault)
+    bool handle_page_fault(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va, bool write_fault, MemStats *stats, PdeBitmap *populated)
     {
         PageNum vpn = page_num(va);
 
-        PageTable pt = ensure_writeable_pt(mmap_tree, pd, vpn);
+        if (stats != nullptr)
+        {
+            stats->faults++;
+        }
+
+        PageTable pt = ensure_writeable_pt(mmap_tree, pd, vpn, stats, populated);
+        PageEntry before = pt[vpn.pti()];
 
-        Helper::ensure_data(mmap_tree, pt, vpn, write_fault);
+        Helper::ensure_data(mmap_tree, pt, vpn, write_fault, stats);
 
         if (getCR3() == pd.address())
         {
             invlpg(va);
+
+            // a broken COW moved the page, the other threads may still have the old one cached
+            if (before.flags().is(Flags::PRESENT) && before.ppn() != pt[vpn.pti()].ppn())
+            {
+                Shared<ThreadGroup> group = PCB::current().group;
+                if (!(group == Shared<ThreadGroup>::NUL))
+                {
+                    group->flush_other_tlbs();
+                }
+            }
         }
         return true;
     }
 
+    PhysicalAddress user_word_address(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageDir pd, VirtualAddress va, MemStats *stats, PdeBitmap *populated)
+    {
+        if ((va & 3) != 0 || !is_region_in_user_mem(va, va + 4))
+        {
+            return 0;
+        }
+
+        MMAPBlock *block = Helper::containing_block(mmap_tree, page_num(va));
+        if (block == nullptr || block->flags.is_not(Flags::MMAP_RW) || block->flags.is_not(Flags::MMAP_USER))
+        {
+            return 0;
+        }
+
+        // both levels have to be writeable, a shared page table is read only in the PD
+        PageNum vpn = page_num(va);
+        Flags writeable = Flags::PRESENT | Flags::READ_WRITE;
+        PageEntry &pde = pd[vpn.pdi()];
+        if (pde.flags().is_not(writeable) || PageTable(pde.ppn())[vpn.pti()].flags().is_not(writeable))
+        {
+            handle_page_fault(mmap_tree, pd, va, true, stats, populated);
+        }
+
+        PageTable pt = pd[vpn.pdi()].ppn();
+        return pt[vpn.pti()].address() + (va & (PAGE_SIZE - 1));
+    }
+
+    uint32_t count_mmap_blocks(RBTree<MMAPBlock *, NoLock> *mmap_tree, PageNum start, uint32_t size)
+    {
+        uint32_t blocks = 0;
+        mmap_tree->foreach_data(start, PageNum(start + size - 1), CompareFunction<PageNum, MMAPBlock *>(), [&blocks](MMAPBlock *block)
+                                {
+        blocks++;
+        return true; });
+        return blocks;
+    }
+
     bool check_user_page_fault(RBTree<MMAPBlock *, NoLock> *mmap_tree, uint32_t error_code, VirtualAddress va)
     {
         // check that its in user space
@@ -515,17 +722,29 @@ namespace PageCache
         zero_page = get_smart_page<char>();
     }
 
-    SmartPhysPage<char> BadPageCache::get_ro_file_page(Shared<Node> node, PageNum off)
+    SmartPhysPage<char> BadPageCache::get_ro_file_page(Shared<Node> node, PageNum off, bool *loaded)
     {
-        LockGuard{guard};
+        // pages are never dropped from the cache, so a hit needs no lock
         FilePage fp = FilePage(node, off);
-        PageEntry pe = bad_pc_map->get(fp);
+        PageEntry pe = bad_pc_map->read(fp);
+        if (pe.flags().is(Flags::PRESENT))
+        {
+            return pe.ppn();
+        }
+
+        // someone else may have loaded it since we looked
+        LockGuard g{guard};
+        pe = bad_pc_map->get(fp);
         if (pe.flags().is_not(Flags::PRESENT))
         {
             SmartPhysPage<char> data_page = get_smart_page<char>();
             node->read_all(off.to_address(), PAGE_SIZE, (char *)data_page.address());
             pe.smart_set(PageEntry(data_page.ppn(), Flags::PRESENT));
             bad_pc_map->put(fp, pe);
+            if (loaded != nullptr)
+            {
+                *loaded = true;
+            }
         }
         return pe.ppn();
     }
@@ -569,6 +788,16 @@ namespace VMM
         return start >= VA_USER_START && start <= end && end <= VA_USER_END;
     }
 
+    MemStats user_mem_stats(RBTree<MMAPBlock *, NoLock> *mmap_tree, const MemStats &counted_stats)
+    {
+        PageNum start = page_num(VA_USER_START);
+        uint32_t size = page_num(VA_USER_END) - start;
+
+        MemStats stats = counted_stats;
+        stats.mmap_blocks = count_mmap_blocks(mmap_tree, start, size);
+        return stats;
+    }
+
     // Called (on the initial core) to initialize data structures, etc
     void global_init()
     {
@@ -588,9 +817,22 @@ namespace VMM
         // we need to look at the current mappings
         // Debug::printf("*** page fault at %x\n", va);
         RBTree<MMAPBlock *, NoLock> *current_mmap_tree = PCB::current().mmap_tree;
+        bool safe;
 
-        // check if this is not a safe pagefault if we are coming from user mode
-        if (regs->cs == userCS && !check_user_page_fault(current_mmap_tree, PCB::current().regs.error_code, va))
+        {
+            // the other threads may be changing the tree or faulting on the same page tables
+            AddressSpaceGuard guard{};
+
+            // check if this is not a safe pagefault if we are coming from user mode
+            safe = regs->cs != userCS || check_user_page_fault(current_mmap_tree, PCB::current().regs.error_code, va);
+            if (safe)
+            {
+                bool write_fault = Flags(regs->error_code).is(Flags::READ_WRITE);
+                SmartVMM::handle_page_fault(current_mmap_tree, Process::current().pd, va, write_fault, &PCB::current().stats(), &PCB::current().populated_pdes);
+            }
+        }
+
+        if (!safe)
         {
             // check if this is implicit sigreturn
             if (va == SYS::Helper::VA_IMPLICIT_SIGRET)
@@ -608,10 +850,6 @@ namespace VMM
             *(VirtualAddress *)(VA_USER_SHARED_FAULT_ADDR) = va;
             SYS::Call::exit(139);
         }
-
-        bool write_fault = Flags(regs->error_code).is(Flags::READ_WRITE);
-
-        SmartVMM::handle_page_fault(current_mmap_tree, Process::current().pd, va, write_fault);
         // Debug::shutdown();
     }
 
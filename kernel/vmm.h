@@ -123,7 +123,7 @@ class SmartPhysPage;
 
 // the reference count array
 extern PageRefCount* physical_page_reference_counts;
-extern SpinLock* physical_page_locks;
+extern TasLock* physical_page_locks;
 
 namespace Helper {
 
@@ -469,6 +469,70 @@ namespace PDTypes {
 typedef PhysPage<PageEntry> PageTable;
 typedef SmartPhysPage<PageEntry> PageDir;
 
+class PdeBitmap;
+
+// ------------------- definitions --------------------
+
+/**
+ * tracks which entries of a page dir have ever had a page table,
+ * so walking a mostly empty page dir only touches the populated entries
+ */
+class PdeBitmap {
+    static constexpr uint32_t BITS = 32;
+    uint32_t words[ENTRIES_PER_PAGE / BITS];
+
+   public:
+    inline PdeBitmap();
+
+    inline void set(uint32_t pdi);
+    inline bool is_set(uint32_t pdi) const;
+
+    /**
+     * calls work(uint32_t pdi) for each set entry in increasing order
+     */
+    template <typename Work>
+    inline void foreach_set(Work work) const;
+
+    /**
+     * builds the bitmap of the present entries of a page dir
+     */
+    static inline PdeBitmap of(PageDir pd);
+};
+
+inline PdeBitmap::PdeBitmap() : words() {}
+
+inline void PdeBitmap::set(uint32_t pdi) {
+    ASSERT(pdi < ENTRIES_PER_PAGE);
+    words[pdi / BITS] |= 1 << (pdi % BITS);
+}
+
+inline bool PdeBitmap::is_set(uint32_t pdi) const {
+    ASSERT(pdi < ENTRIES_PER_PAGE);
+    return (words[pdi / BITS] >> (pdi % BITS)) & 1;
+}
+
+template <typename Work>
+inline void PdeBitmap::foreach_set(Work work) const {
+    for (uint32_t w = 0; w < ENTRIES_PER_PAGE / BITS; w++) {
+        uint32_t bits = words[w];
+        while (bits != 0) {
+            uint32_t bit = __builtin_ctz(bits);
+            bits &= bits - 1;
+            work(w * BITS + bit);
+        }
+    }
+}
+
+inline PdeBitmap PdeBitmap::of(PageDir pd) {
+    PdeBitmap bitmap{};
+    for (uint32_t pdi = 0; pdi < ENTRIES_PER_PAGE; pdi++) {
+        if (pd[pdi].flags().is(Flags::PRESENT)) {
+            bitmap.set(pdi);
+        }
+    }
+    return bitmap;
+}
+
 }  // namespace PDTypes
 
 namespace MMAPTypes {
@@ -538,8 +602,73 @@ inline Flags MMAPBlock::compute_page_entry_flags() {
 
 }  // namespace MMAPTypes
 
+namespace StatTypes {
+
+// ------------------- declarations --------------------
+
+struct MemStats;
+
+// ------------------- definitions --------------------
+
+/**
+ * memory and fault counters for an address space. the layout is shared with
+ * user space through the memstats syscall, so only add to the end
+ */
+struct MemStats {
+    // the number of real user pages that are mapped in
+    uint32_t resident_pages;
+
+    // the number of user mmap blocks, computed when a snapshot is taken
+    uint32_t mmap_blocks;
+
+    // all faults handled, major_faults included
+    uint32_t faults;
+
+    // faults that had to read file data
+    uint32_t major_faults;
+
+    // writes to read only data pages that were claimed or copied
+    uint32_t cow_breaks;
+
+    // shared page tables that had to be copied
+    uint32_t pt_copies;
+
+    // new pages that were backed by the zero page
+    uint32_t zero_page_maps;
+
+    // new pages that were backed by a file
+    uint32_t file_faults;
+
+    inline MemStats();
+
+    inline void add(const MemStats& other);
+};
+
+inline MemStats::MemStats() : resident_pages(0),
+                              mmap_blocks(0),
+                              faults(0),
+                              major_faults(0),
+                              cow_breaks(0),
+                              pt_copies(0),
+                              zero_page_maps(0),
+                              file_faults(0) {}
+
+inline void MemStats::add(const MemStats& other) {
+    resident_pages += other.resident_pages;
+    mmap_blocks += other.mmap_blocks;
+    faults += other.faults;
+    major_faults += other.major_faults;
+    cow_breaks += other.cow_breaks;
+    pt_copies += other.pt_copies;
+    zero_page_maps += other.zero_page_maps;
+    file_faults += other.file_faults;
+}
+
+}  // namespace StatTypes
+
 using namespace PDTypes;
 using namespace MMAPTypes;
+using namespace StatTypes;
 
 /**
  * =================================================================
@@ -571,19 +700,23 @@ void foreach_allocated_vpn(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageNum start,
 
 /**
  * ensure that the page table is in the PD, allocating one if its not there, or handling COW
+ * counts into stats and marks new page tables in populated if given
  */
-extern PageTable ensure_writeable_pt(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, PageNum vpn);
+extern PageTable ensure_writeable_pt(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, PageNum vpn, MemStats* stats = nullptr, PdeBitmap* populated = nullptr);
 
 /**
  * assumes that the data page is supposed to be read write and the pt is safe to change
  * ensures that the page is in the PT, allocating one if its not there, or cloning it for COW
+ * counts into stats if given
  */
-extern PhysPage<char> ensure_data(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageTable pt, PageNum vpn, bool writeable);
+extern PhysPage<char> ensure_data(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageTable pt, PageNum vpn, bool writeable, MemStats* stats = nullptr);
 
 /**
  * removes a data page from a page table. returns whether a page was removed
+ * counts into stats if given. with dropped, a frame that lost its last reference
+ * is left there for the caller to free instead of being freed
  */
-extern bool remove_mapping(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, PageNum vpn, MMAPBlock* containing_mmap_block);
+extern bool remove_mapping(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, PageNum vpn, MMAPBlock* containing_mmap_block, MemStats* stats = nullptr, PageNum* dropped = nullptr);
 
 }  // namespace Helper
 
@@ -609,8 +742,27 @@ extern void destroy_mmap_tree(RBTree<MMAPBlock*, NoLock>* mmap_tree);
 /**
  * creates a new page dir that is like the given one, assuming COW
  * basically just shallow copies the given PD while marking both with COW Read only
+ * only the entries in populated are visited if it is given
+ */
+extern PageDir create_page_dir_like(PageDir pd_to_copy, const PdeBitmap* populated = nullptr);
+
+/**
+ * makes sure every page table the mmap tree covers in [start, end) is in pd and writeable,
+ * so it can be handed to other threads as it is
+ */
+extern void populate_page_tables(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress start, VirtualAddress end, PdeBitmap* populated = nullptr);
+
+/**
+ * maps the kernel frame at pa at va in pd with the given page entry flags.
+ * the frame is not reference counted, so the mmap block there should not be MMAP_REAL
  */
-extern PageDir create_page_dir_like(PageDir pd_to_copy);
+extern void map_kernel_frame(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va, PhysicalAddress pa, Flags flags, PdeBitmap* populated = nullptr);
+
+/**
+ * creates a page dir for another thread of pd. the writeable page tables in [start, end)
+ * become the same frames in both, everything else is COW like create_page_dir_like
+ */
+extern PageDir create_thread_page_dir(PageDir pd, VirtualAddress start, VirtualAddress end, const PdeBitmap* populated);
 
 /**
  * destroy a page directory, deallocating memory as needed
@@ -644,13 +796,27 @@ extern void* mmap(RBTree<MMAPBlock*, NoLock>* mmap_tree, VirtualAddress va, uint
 
 /**
  * munmaps a regions
+ * counts into stats if given
  */
-extern bool munmap_containing_block(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va);
+extern bool munmap_containing_block(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va, MemStats* stats = nullptr);
 
 /**
  * handles a pagefault, returning whether it was a success or not
+ * counts the fault into stats and marks new page tables in populated if given
+ */
+extern bool handle_page_fault(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va, bool write_fault, MemStats* stats = nullptr, PdeBitmap* populated = nullptr);
+
+/**
+ * makes the aligned user word at va present and writeable in pd, returning its physical address,
+ * or 0 if it is not in a read write user mapping.
+ * a COW page gets its own copy first, so the address stays the same until it is unmapped
+ */
+extern PhysicalAddress user_word_address(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va, MemStats* stats = nullptr, PdeBitmap* populated = nullptr);
+
+/**
+ * counts the mmap blocks overlapping a vpn range
  */
-extern bool handle_page_fault(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageDir pd, VirtualAddress va, bool write_fault);
+extern uint32_t count_mmap_blocks(RBTree<MMAPBlock*, NoLock>* mmap_tree, PageNum start, uint32_t size);
 
 /**
  * checks that a pagefault is safe for the user
@@ -746,8 +912,9 @@ class BadPageCache {
 
     /**
      * get a page that has the data of a file in it
+     * sets loaded (if given) when the page had to be read from the file
      */
-    static SmartPhysPage<char> get_ro_file_page(Shared<Node> node, PageNum off);
+    static SmartPhysPage<char> get_ro_file_page(Shared<Node> node, PageNum off, bool* loaded = nullptr);
 
     /**
      * reads data from a file. assumes that mmap without MMAP_F_UNALGN does not use this
@@ -786,10 +953,18 @@ constexpr VirtualAddress VA_USER_SHARED_FAULT_ADDR = 0xF0000800;
 constexpr VirtualAddress VA_USER_SHARED_END = 0xF0001000;
 constexpr VirtualAddress VA_USER_END = 0xF0001000;
 
+// the clock, past the PCB page. users can read it but it is not user memory
+constexpr VirtualAddress VA_USER_TIME = 0xF0002000;
+
 constexpr VirtualAddress VA_PAGE_CACHE = 0x20000000;
 
 extern bool is_region_in_user_mem(VirtualAddress start, VirtualAddress end);
 
+/**
+ * takes a snapshot of the user memory stats for an address space
+ */
+extern MemStats user_mem_stats(RBTree<MMAPBlock*, NoLock>* mmap_tree, const MemStats& counted_stats);
+
 // Called (on the initial core) to initialize data structures, etc
 extern void global_init();
 
@@ -0,0 +1,32 @@
+#include "watch.h"
+#include "heap.h"
+
+void WatchList::add(Watcher* w) {
+    lock.lock();
+    first = new Link(w, first);
+    lock.unlock();
+}
+
+void WatchList::remove(Watcher* w) {
+    Link* gone = nullptr;
+    lock.lock();
+    for (Link** pprev = &first; *pprev != nullptr; pprev = &(*pprev)->next) {
+        if ((*pprev)->w == w) {
+            gone = *pprev;
+            *pprev = gone->next;
+            break;
+        }
+    }
+    lock.unlock();
+    delete gone;
+}
+
+void WatchList::notify() {
+    // the lock also orders our caller's change before the look at first, so a
+    // watcher that checks after adding itself can't miss both
+    lock.lock();
+    for (Link* l = first; l != nullptr; l = l->next) {
+        l->w->changed();
+    }
+    lock.unlock();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "atomic.h"
+
+// something waiting on more than one thing at once. it hears about every
+// change to each thing it watches until it takes itself off that thing's list
+struct Watcher {
+    virtual ~Watcher() {}
+
+    // called with the list locked, so it must not block or touch the list
+    virtual void changed() = 0;
+};
+
+// the watchers of one thing. once remove returns, the watcher won't hear
+// from this list again
+class WatchList {
+    struct Link {
+        Watcher* const w;
+        Link* next;
+        Link(Watcher* w, Link* next) : w(w), next(next) {}
+    };
+
+    SpinLock lock{};
+    Link* first = nullptr;
+
+public:
+    WatchList() {}
+    WatchList(const WatchList&) = delete;
+
+    void add(Watcher* w);
+
+    // takes out one of w's links, a watcher added twice has to be removed twice
+    void remove(Watcher* w);
+
+    // tells every watcher something changed
+    void notify();
+};
@@ -0,0 +1,188 @@
+#include "libc.h"
+
+// poll waits on several files at once, and a non-blocking read takes
+// whatever a pipe has instead of waiting for all it asked for
+
+#define WRITERS 3
+#define MESSAGES 20
+#define MESSAGE 16
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// poll with nothing to watch is a sleep
+void sleep_ms(int ms)
+{
+    poll(0, 0, ms);
+}
+
+// answers that are there already, a bad fd and one left out
+void ready_now(void)
+{
+    int w1, r1, w2, r2;
+    pipe(&w1, &r1);
+    pipe(&w2, &r2);
+    write(w1, "x", 1);
+
+    struct pollfd fds[5] = {
+        { r1, POLLIN, 0 },
+        { r2, POLLIN, 0 },
+        { w2, POLLOUT | POLLIN, 0 },
+        { 9, POLLIN, 0 },
+        { -1, POLLIN, 0 },
+    };
+    int n = poll(fds, 5, 0);
+    int ok = n == 3 && fds[0].revents == POLLIN && fds[1].revents == 0 &&
+             fds[2].revents == POLLOUT && fds[3].revents == POLLNVAL && fds[4].revents == 0;
+
+    char c;
+    ok = ok && read(r1, &c, 1) == 1 && c == 'x' && poll(fds, 2, 0) == 0;
+    close(w1);
+    close(r1);
+    close(w2);
+    close(r2);
+    printf("*** ready %s\n", ok ? "ok" : "failed");
+}
+
+// the second pipe gets something while we wait on both
+void wakes_up(void)
+{
+    int w1, r1, w2, r2;
+    pipe(&w1, &r1);
+    pipe(&w2, &r2);
+    if (fork() == 0)
+    {
+        sleep_ms(20);
+        exit(write(w2, "y", 1));
+    }
+    struct pollfd fds[2] = {
+        { r1, POLLIN, 0 },
+        { r2, POLLIN, 0 },
+    };
+    int n = poll(fds, 2, -1);
+    char c = 0;
+    int ok = n == 1 && fds[0].revents == 0 && fds[1].revents == POLLIN &&
+             read(r2, &c, 1) == 1 && c == 'y' && join() == 1;
+    close(w1);
+    close(r1);
+    close(w2);
+    close(r2);
+    printf("*** wake %s\n", ok ? "ok" : "failed");
+}
+
+void times_out(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    struct pollfd fds[1] = { { r, POLLIN, POLLIN } };
+    unsigned start = cycles();
+    int n = poll(fds, 1, 30);
+    unsigned waited = cycles() - start;
+    close(w);
+    close(r);
+    printf("*** timeout %s\n", n == 0 && fds[0].revents == 0 && waited != 0 ? "ok" : "failed");
+}
+
+void non_blocking(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    char buf[10] = { 0 };
+    int ok = nonblock(r, 1) == 0 && read(r, buf, sizeof(buf)) == 0;
+    write(w, "abc", 3);
+    ok = ok && read(r, buf, sizeof(buf)) == 3 && strcmp(buf, "abc") == 0;
+
+    // and back to waiting for all of it
+    ok = ok && nonblock(r, 0) == 0 && nonblock(9, 1) == -1;
+    write(w, "defg", 4);
+    ok = ok && read(r, buf, 4) == 4 && buf[3] == 'g';
+    close(w);
+    close(r);
+    printf("*** nonblock %s\n", ok ? "ok" : "failed");
+}
+
+// one process reads writers that each go at their own pace, more than a
+// pipe holds from each, taking whatever poll says has come in
+void multiplex(void)
+{
+    struct pollfd fds[WRITERS];
+    int writes[WRITERS];
+    int got[WRITERS] = { 0 };
+    for (int i = 0; i < WRITERS; i++)
+    {
+        int r;
+        pipe(&writes[i], &r);
+        int w = writes[i];
+        if (fork() == 0)
+        {
+            char msg[MESSAGE];
+            for (int k = 0; k < MESSAGE; k++)
+            {
+                msg[k] = 'a' + i;
+            }
+            for (int m = 0; m < MESSAGES; m++)
+            {
+                if (m % (i + 2) == 0)
+                {
+                    sleep_ms(2);
+                }
+                write(w, msg, MESSAGE);
+            }
+            exit(0);
+        }
+        nonblock(r, 1);
+        fds[i].fd = r;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    int ok = 1;
+    int left = WRITERS * MESSAGES * MESSAGE;
+    int polls = 0;
+    while (ok && left > 0)
+    {
+        int n = poll(fds, WRITERS, 1000);
+        ok = n > 0;
+        polls++;
+        for (int i = 0; ok && i < WRITERS; i++)
+        {
+            if (fds[i].revents & POLLIN)
+            {
+                char buf[64];
+                int k = read(fds[i].fd, buf, sizeof(buf));
+                for (int j = 0; j < k; j++)
+                {
+                    ok = ok && buf[j] == 'a' + i;
+                }
+                got[i] += k;
+                left -= k;
+            }
+        }
+    }
+    for (int i = 0; i < WRITERS; i++)
+    {
+        join();
+        ok = ok && got[i] == MESSAGES * MESSAGE;
+        close(writes[i]);
+        close(fds[i].fd);
+    }
+    printf("%d polls for %d messages\n", polls, WRITERS * MESSAGES);
+    printf("*** multiplex %s\n", ok ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** poll\n");
+    ready_now();
+    wakes_up();
+    times_out();
+    non_blocking();
+    multiplex();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
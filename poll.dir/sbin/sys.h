@@ -0,0 +1,147 @@
+#ifndef _SYS_H_
+#define _SYS_H_
+
+/****************/
+/* System calls */
+/****************/
+
+typedef int ssize_t;
+typedef unsigned int size_t;
+
+/* exit, after flushing stdio */
+extern void exit(int rc);
+extern void _exit(int rc) __attribute__((noreturn));
+
+/* write */
+extern ssize_t write(int fd, void* buf, size_t nbyte);
+
+/* fork, after flushing stdio */
+extern int fork();
+extern int _fork();
+
+/* execl */
+extern int execl(const char *pathname, const char *arg, ...
+                       /* (char  *) NULL */);
+
+/* shutdown, after flushing stdio */
+extern void shutdown(void);
+extern void _shutdown(void);
+
+/* join */
+extern int join(void);
+
+/* sem */
+extern int sem(unsigned int);
+
+/* up */
+extern int up(unsigned int);
+
+/* down */
+extern int down(unsigned int);
+
+/* sem_close */
+extern int sem_close(int s);
+
+//1005
+extern void* simple_mmap(void* addr, unsigned size, int fd, unsigned offset);
+
+/* simple_signal */
+extern void simple_signal(void (*pf)(int, unsigned int));
+
+extern void sigreturn(); 
+
+//1008
+extern int simple_munmap(void* addr); 
+
+//1020
+extern void chdir(char* path);
+
+//1021
+extern int open(char* path);
+
+//1022
+extern int close(int fd);
+
+//1037, 1 for the terminal, 0 for files and pipes, -1 for a bad fd
+extern int isatty(int fd);
+
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+
+//1038, reads into count (at most 64) segments in order, returns the total
+extern int readv(int fd, struct iovec* iov, int count);
+
+//1039, writes count (at most 64) segments in order, returns the total
+extern int writev(int fd, struct iovec* iov, int count);
+
+//1040, reads at offset and leaves the file's offset alone
+extern int pread(int fd, void* buffer, unsigned count, unsigned offset);
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+//1041, moves the offset everyone sharing fd sees, returns the new one or -1
+extern int lseek(int fd, int offset, int whence);
+
+//1042, moves count bytes from in_fd to out_fd without copying them through us.
+//starts at *offset and moves it when offset isn't 0, otherwise at in_fd's offset
+extern int sendfile(int out_fd, int in_fd, unsigned* offset, unsigned count);
+
+struct pollfd {
+    int fd;
+    short events;
+    short revents;
+};
+
+#define POLLIN 0x1
+#define POLLOUT 0x4
+#define POLLNVAL 0x20
+
+//1043, waits until one of the count fds is ready for its events or timeout ms pass.
+//a negative timeout waits for good, 0 doesn't wait. returns how many have revents
+extern int poll(struct pollfd* fds, int count, int timeout);
+
+//1044, with on set reads of fd return what is already there, possibly 0 bytes
+extern int nonblock(int fd, int on);
+
+//1023
+extern int len(int fd);
+
+//1024, after flushing stdout when fd is 0
+extern int read(int fd, void* buffer, unsigned count);
+extern int _read(int fd, void* buffer, unsigned count);
+
+//1026
+extern int pipe(int* write_fd, int* read_fd);
+
+//1027
+extern int dup(int fd);
+
+// 1100
+extern char getch();
+
+//1101
+extern int tui();
+
+//1102
+extern int set_tui(int fd);
+
+//1033, 0 once woken, 1 if *addr was not expected, -1 for a bad address
+extern int futex_wait(int* addr, int expected);
+
+//1034, returns how many it woke
+extern int futex_wake(int* addr, int n);
+
+//1035, runs a thread of this process at eip with its stack at esp, returns its id or -1
+extern int thread_create(void* eip, void* esp);
+
+//1036, returns what the thread exited with, -1 if it is not ours to join
+extern int thread_join(int tid);
+
+// ends only the calling thread
+extern void thread_exit(int status);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "libc.h"
+
+// Children of one process share the offset of the files it opened.
+// pread leaves that offset alone, read and lseek move it for everyone
+
+#define LINES 32
+#define LINE 64
+#define READERS 4
+
+// "line NN " followed by letters starting NN places into the alphabet
+int is_line(const char* p, int i)
+{
+    return p[0] == 'l' && p[5] == '0' + i / 10 && p[6] == '0' + i % 10 &&
+           p[8] == 'a' + i % 26 && p[LINE - 1] == '\n';
+}
+
+int line_number(const char* p)
+{
+    return (p[5] - '0') * 10 + (p[6] - '0');
+}
+
+// each child reads its own quarter of the file, all at once
+void positional(void)
+{
+    int fd = open("/lines.txt");
+    for (int c = 0; c < READERS; c++)
+    {
+        if (fork() == 0)
+        {
+            char buf[LINE];
+            int ok = 1;
+            for (int i = c * (LINES / READERS); i < (c + 1) * (LINES / READERS); i++)
+            {
+                ok = ok && pread(fd, buf, LINE, i * LINE) == LINE && is_line(buf, i);
+            }
+            exit(ok);
+        }
+    }
+    int ok = 1;
+    for (int c = 0; c < READERS; c++)
+    {
+        ok = ok && join() == 1;
+    }
+
+    char buf[LINE];
+    ok = ok && read(fd, buf, LINE) == LINE && is_line(buf, 0);
+    close(fd);
+    printf("*** pread %s\n", ok ? "ok" : "failed");
+}
+
+// every line goes to exactly one of the children reading the shared offset
+void shared_offset(void)
+{
+    int fd = open("/lines.txt");
+    for (int c = 0; c < READERS; c++)
+    {
+        if (fork() == 0)
+        {
+            char buf[LINE];
+            unsigned mask = 0;
+            for (int i = 0; i < LINES / READERS; i++)
+            {
+                if (read(fd, buf, LINE) != LINE)
+                {
+                    exit(0);
+                }
+                mask |= 1u << line_number(buf);
+            }
+            exit(mask);
+        }
+    }
+    unsigned all = 0;
+    int lines = 0;
+    for (int c = 0; c < READERS; c++)
+    {
+        unsigned mask = join();
+        all |= mask;
+        for (int i = 0; i < LINES; i++)
+        {
+            lines += (mask >> i) & 1;
+        }
+    }
+    close(fd);
+    printf("*** shared offset %s\n", all == 0xffffffff && lines == LINES ? "ok" : "failed");
+}
+
+void seeking(void)
+{
+    int fd = open("/lines.txt");
+    char buf[LINE];
+    int w, r;
+    pipe(&w, &r);
+
+    int ok = lseek(fd, 0, SEEK_END) == LINES * LINE &&
+             lseek(fd, -LINE, SEEK_END) == (LINES - 1) * LINE &&
+             read(fd, buf, LINE) == LINE && is_line(buf, LINES - 1) &&
+             lseek(fd, 0, SEEK_CUR) == LINES * LINE &&
+             lseek(fd, 3 * LINE, SEEK_SET) == 3 * LINE &&
+             read(fd, buf, LINE) == LINE && is_line(buf, 3) &&
+             pread(fd, buf, LINE, LINES * LINE) == 0 &&
+             lseek(fd, -1, SEEK_SET) == -1 &&
+             lseek(fd, 0, 7) == -1 &&
+             lseek(r, 0, SEEK_SET) == -1 &&
+             pread(r, buf, 1, 0) == -1;
+
+    close(w);
+    close(r);
+    close(fd);
+    printf("*** seek %s\n", ok ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** pread\n");
+    positional();
+    shared_offset();
+    seeking();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
@@ -1,23 +1,23 @@
 #include "libc.h"
 
+size_t strlen(const char *p)
+{
+    size_t n = 0;
+    while (p[n] != 0)
+        n++;
+    return n;
+}
+
 int putchar(int c)
 {
-    char t = (char)c;
-    return write(1, &t, 1);
+    return fputc(c, stdout);
 }
 
 int print(const char *p)
 {
-    char c;
-    int count = 0;
-    while ((c = *p++) != 0)
-    {
-        int n = putchar(c);
-        if (n < 0)
-            return n;
-        count++;
-    }
-    return count + 1;
+    if (fputs(p, stdout) < 0)
+        return EOF;
+    return strlen(p) + 1;
 }
 
 void intToStr(int x, char *buffer)
@@ -86,4 +86,63 @@ void printUint(unsigned int x)
 void panic(const char *p) {
     print(p);
     shutdown();
-}
\ No newline at end of file
+}
+
+void mutex_lock(struct mutex* m) {
+    int c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    /* contended, say so before sleeping so the unlock knows to wake us */
+    if (c != 2) {
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        futex_wait(&m->state, 2);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void mutex_unlock(struct mutex* m) {
+    if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex_wake(&m->state, 1);
+    }
+}
+
+void cond_wait(struct cond* c, struct mutex* m) {
+    int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+    mutex_unlock(m);
+    /* a signal after the unlock bumps seq, so the wait returns right away */
+    futex_wait(&c->seq, seq);
+    mutex_lock(m);
+}
+
+void cond_signal(struct cond* c) {
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&c->seq, 1);
+}
+
+void cond_broadcast(struct cond* c) {
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&c->seq, 0x7fffffff);
+}
+
+int spawn_thread(int (*fn)(void*), void* arg, void* stack, unsigned size) {
+    /* fn starts as if it was called from thread_exit */
+    unsigned* sp = (unsigned*)((char*)stack + (size & ~3));
+    *--sp = (unsigned)arg;
+    *--sp = (unsigned)thread_exit;
+    return thread_create((void*)fn, sp);
+}
+
+unsigned long long clock_ns(void) {
+    const struct timepage* t = TIMEPAGE;
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    unsigned long long cycles = (((unsigned long long)hi << 32) | lo) - t->tsc_base;
+
+    /* the same 64 by 32 multiply the kernel does, there is no 128 bit type */
+    unsigned long long low = (cycles & 0xffffffff) * t->mult;
+    unsigned long long high = (cycles >> 32) * t->mult;
+    return (high << (32 - t->shift)) + (low >> t->shift);
+}
@@ -2,8 +2,77 @@
 
 #include "sys.h"
 
+/* buffered output, see stdio.c. there is no heap here, so just stdout and stderr */
+#define EOF (-1)
+#define BUFSIZ 1024
+
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
+typedef struct FILE {
+    int fd;
+    int mode;          /* _IOFBF, _IOLBF or _IONBF, -1 until the first write asks isatty */
+    size_t len;        /* how much of buf is waiting to be written */
+    int lock;
+    struct FILE* next;
+    char buf[BUFSIZ];
+} FILE;
+
+extern FILE* stdout;
+extern FILE* stderr;
+
+extern int fputc(int c, FILE* f);
+extern int fputs(const char* s, FILE* f);
+extern size_t fwrite(const void* p, size_t size, size_t n, FILE* f);
+extern int fflush(FILE* f);
+extern int setvbuf(FILE* f, char* buf, int mode, size_t size);
+
+extern size_t strlen(const char* p);
 extern int putchar(int c);
 extern int print(const char *p);
 extern void printInt(int x);
 extern void printUint(unsigned int x);
 extern void panic(const char *p);
+
+/* a mutex that only traps into the kernel when it is contended.
+   0 is unlocked, 1 is locked, 2 is locked with possible waiters.
+   it can live in shared memory to lock across processes */
+struct mutex {
+    int state;
+};
+
+#define MUTEX_INIT { 0 }
+
+extern void mutex_lock(struct mutex* m);
+extern void mutex_unlock(struct mutex* m);
+
+/* a condition variable to go with a mutex, signals are not remembered */
+struct cond {
+    int seq;
+};
+
+#define COND_INIT { 0 }
+
+extern void cond_wait(struct cond* c, struct mutex* m);
+extern void cond_signal(struct cond* c);
+extern void cond_broadcast(struct cond* c);
+
+/* the clock the kernel maps read only into every process.
+   nanoseconds since boot = ((rdtsc - tsc_base) * mult) >> shift */
+struct timepage {
+    unsigned long long tsc_base;
+    unsigned mult;
+    unsigned shift;
+    unsigned hz;
+    volatile unsigned jiffies;
+};
+
+#define TIMEPAGE ((const struct timepage*)0xF0002000)
+
+/* nanoseconds since boot, without a syscall */
+extern unsigned long long clock_ns(void);
+
+/* runs fn(arg) in a new thread on the given stack, what fn returns is its exit status.
+   the stack has to stay around until the thread is joined */
+extern int spawn_thread(int (*fn)(void*), void* arg, void* stack, unsigned size);
@@ -0,0 +1,57 @@
+#include "libc.h"
+
+// Runs a program and reports how much memory it used and how many faults it took.
+// With no program, reports on itself.
+//
+//     memstat /mypy/python32
+
+static void printStat(const char *name, unsigned int value) {
+    print(name);
+    printUint(value);
+    print("\n");
+}
+
+static void printStats(struct memstats *stats) {
+    printStat("resident pages  : ", stats->resident_pages);
+    printStat("mmap blocks     : ", stats->mmap_blocks);
+    printStat("faults          : ", stats->faults);
+    printStat("    minor       : ", stats->faults - stats->major_faults);
+    printStat("    major       : ", stats->major_faults);
+    printStat("cow breaks      : ", stats->cow_breaks);
+    printStat("pt copies       : ", stats->pt_copies);
+    printStat("zero page maps  : ", stats->zero_page_maps);
+    printStat("file faults     : ", stats->file_faults);
+}
+
+int main(int argc, char **argv) {
+    struct memstats stats;
+
+    if (argc < 2) {
+        if (memstats(MEMSTATS_SELF, &stats) < 0) {
+            panic("memstats failed\n");
+        }
+        printStats(&stats);
+        return 0;
+    }
+
+    int id = fork();
+    if (id < 0) {
+        panic("fork failed\n");
+    }
+    if (id == 0) {
+        execl(argv[1], argv[1], 0);
+        panic("execl failed\n");
+    }
+
+    int rc = join();
+
+    if (memstats(MEMSTATS_CHILDREN, &stats) < 0) {
+        panic("memstats failed\n");
+    }
+    print(argv[1]);
+    print(" exited with ");
+    printInt(rc);
+    print("\n");
+    printStats(&stats);
+    return 0;
+}
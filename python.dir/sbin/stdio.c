@@ -0,0 +1,135 @@
+#include "libc.h"
+
+/* Buffered output on top of write. stdout waits for a newline when it
+   is a terminal and for a full buffer otherwise, stderr never waits.
+   Whatever is still buffered goes out on exit, fork and shutdown,
+   and stdout goes out before a read of fd 0.
+   Without a heap there is no fdopen, stdout and stderr are all we have */
+
+static FILE out = { 1, -1, 0, 0, 0 };
+static FILE err = { 2, _IONBF, 0, 0, &out };
+
+FILE* stdout = &out;
+FILE* stderr = &err;
+
+/* every open FILE, so fflush(0) can get to them */
+static FILE* files = &err;
+static int files_lock = 0;
+
+/* threads share a FILE, they only hold it for as long as a write takes */
+static void lock(int* l) {
+    while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+        __builtin_ia32_pause();
+    }
+}
+
+static void unlock(int* l) {
+    __atomic_store_n(l, 0, __ATOMIC_RELEASE);
+}
+
+static int write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        int done = write(fd, (void*)p, n);
+        if (done <= 0) return EOF;
+        p += done;
+        n -= done;
+    }
+    return 0;
+}
+
+static int drain(FILE* f) {
+    int rc = write_all(f->fd, f->buf, f->len);
+    f->len = 0;
+    return rc;
+}
+
+/* with f locked */
+static int put(FILE* f, const char* p, size_t n) {
+    if (f->mode < 0) {
+        f->mode = isatty(f->fd) == 1 ? _IOLBF : _IOFBF;
+    }
+    if (f->mode == _IONBF) {
+        return write_all(f->fd, p, n);
+    }
+
+    int newline = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (f->len == BUFSIZ && drain(f) < 0) return EOF;
+        f->buf[f->len++] = p[i];
+        newline |= p[i] == '\n';
+    }
+    if (newline && f->mode == _IOLBF) {
+        return drain(f);
+    }
+    return 0;
+}
+
+int fputc(int c, FILE* f) {
+    char t = (char)c;
+    lock(&f->lock);
+    int rc = put(f, &t, 1);
+    unlock(&f->lock);
+    return rc < 0 ? EOF : (unsigned char)t;
+}
+
+int fputs(const char* s, FILE* f) {
+    lock(&f->lock);
+    int rc = put(f, s, strlen(s));
+    unlock(&f->lock);
+    return rc;
+}
+
+size_t fwrite(const void* p, size_t size, size_t n, FILE* f) {
+    lock(&f->lock);
+    int rc = put(f, p, size * n);
+    unlock(&f->lock);
+    return rc < 0 ? 0 : n;
+}
+
+int fflush(FILE* f) {
+    if (f == 0) {
+        int rc = 0;
+        lock(&files_lock);
+        for (FILE* g = files; g != 0; g = g->next) {
+            if (fflush(g) < 0) rc = EOF;
+        }
+        unlock(&files_lock);
+        return rc;
+    }
+    lock(&f->lock);
+    int rc = drain(f);
+    unlock(&f->lock);
+    return rc;
+}
+
+/* our buffer lives in the FILE, so only the mode is taken */
+int setvbuf(FILE* f, char* buf, int mode, size_t size) {
+    if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) return EOF;
+    lock(&f->lock);
+    int rc = drain(f);
+    f->mode = mode;
+    unlock(&f->lock);
+    return rc;
+}
+
+void exit(int status) {
+    fflush(0);
+    _exit(status);
+}
+
+/* or the child would write out our buffers a second time */
+int fork(void) {
+    fflush(0);
+    return _fork();
+}
+
+/* so whatever was asked for, or echoed, is on the screen before we wait */
+int read(int fd, void* buffer, unsigned count) {
+    if (fd == 0) fflush(stdout);
+    return _read(fd, buffer, count);
+}
+
+void shutdown(void) {
+    fflush(0);
+    _shutdown();
+}
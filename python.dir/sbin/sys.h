@@ -8,18 +8,21 @@
 typedef int ssize_t;
 typedef unsigned int size_t;
 
-/* exit */
+/* exit, after flushing stdio */
 extern void exit(int rc);
+extern void _exit(int rc) __attribute__((noreturn));
 
-/* fork */
+/* fork, after flushing stdio */
 extern int fork();
+extern int _fork();
 
 /* execl */
 extern int execl(const char *pathname, const char *arg, ...
                        /* (char  *) NULL */);
 
-/* shutdown */
+/* shutdown, after flushing stdio */
 extern void shutdown(void);
+extern void _shutdown(void);
 
 /* join */
 extern int join(void);
@@ -57,11 +60,15 @@ int open(char* path);
 /* close */
 int close(int fd);
 
+/* isatty, 1 for the terminal, 0 for files and pipes, -1 for a bad fd */
+int isatty(int fd);
+
 /* len */
 int len(int fd);
 
-/* read */
+/* read, after flushing stdout when reading 0 */
 int read(int fd, void* buffer, unsigned count);
+int _read(int fd, void* buffer, unsigned count);
 
 /* write */
 int write(int fd, void* buffer, unsigned count);
@@ -69,4 +76,45 @@ int write(int fd, void* buffer, unsigned count);
 /* pipe */
 int pipe(int* write_fd, int* read_fd);
 
+/* memstats, same layout as the kernel's MemStats */
+struct memstats {
+    unsigned int resident_pages;
+    unsigned int mmap_blocks;
+    unsigned int faults;
+    unsigned int major_faults;
+    unsigned int cow_breaks;
+    unsigned int pt_copies;
+    unsigned int zero_page_maps;
+    unsigned int file_faults;
+};
+
+#define MEMSTATS_SELF 0
+#define MEMSTATS_CHILDREN 1
+
+int memstats(int who, struct memstats* out);
+
+/* nice, adds to the nice level (-20 to 19) and returns the new one */
+int nice(int inc);
+
+/* affinity, limits us to the cores in mask (one bit each) and returns the old mask.
+   a mask of 0 just returns the current one */
+int affinity(unsigned mask);
+
+/* futex_wait, sleeps until woken if *addr still holds expected.
+   returns 0 once woken, 1 if *addr had already changed and -1 for a bad address */
+int futex_wait(int* addr, int expected);
+
+/* futex_wake, wakes up to n waiters on addr and returns how many it woke */
+int futex_wake(int* addr, int n);
+
+/* thread_create, starts another thread of this process at eip with its stack at esp.
+   it shares our memory and open files. returns its id or -1 */
+int thread_create(void* eip, void* esp);
+
+/* thread_join, waits for the thread to exit and returns its status, -1 if it is not ours */
+int thread_join(int tid);
+
+/* thread_exit, ends only the calling thread */
+void thread_exit(int status);
+
 #endif
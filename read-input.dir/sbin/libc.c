@@ -1,19 +1,16 @@
 #include "libc.h"
 
 int putchar(int c) {
-    char t = (char)c;
-    return write(1,&t,1);
+    return fputc(c, stdout);
 }
 
 int puts(const char* p) {
-    char c;
-    int count = 0;
-    while ((c = *p++) != 0) {
-        int n = putchar(c); 
-        if (n < 0) return n;
-        count ++;
-    }
-    putchar('\n');
-    
-    return count+1;
+    if (fputs(p, stdout) < 0 || fputc('\n', stdout) < 0) return EOF;
+    return strlen(p) + 1;
+}
+
+size_t strlen(const char* p) {
+    size_t n = 0;
+    while (p[n] != 0) n++;
+    return n;
 }
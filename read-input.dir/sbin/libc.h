@@ -16,6 +16,36 @@ extern void* realloc(void* ptr, size_t newSize);
 void* memset(void* p, int val, size_t sz);
 void* memcpy(void* dest, void* src, size_t n);
 
+extern size_t strlen(const char* p);
+
+/* buffered output, see stdio.c */
+#define EOF (-1)
+#define BUFSIZ 1024
+
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
+typedef struct FILE {
+    int fd;
+    int mode;          /* _IOFBF, _IOLBF or _IONBF, -1 until the first write asks isatty */
+    size_t len;        /* how much of buf is waiting to be written */
+    int lock;
+    struct FILE* next;
+    char buf[BUFSIZ];
+} FILE;
+
+extern FILE* stdout;
+extern FILE* stderr;
+
+extern int fputc(int c, FILE* f);
+extern int fputs(const char* s, FILE* f);
+extern size_t fwrite(const void* p, size_t size, size_t n, FILE* f);
+extern int fflush(FILE* f);
+extern int setvbuf(FILE* f, char* buf, int mode, size_t size);
+extern FILE* fdopen(int fd, const char* mode);
+extern int fclose(FILE* f);
+
 extern int putchar(int c);
 extern int puts(const char *p);
 
@@ -8,21 +8,24 @@
 typedef int ssize_t;
 typedef unsigned int size_t;
 
-/* exit */
+/* exit, after flushing stdio */
 extern void exit(int rc);
+extern void _exit(int rc) __attribute__((noreturn));
 
 /* write */
 extern ssize_t write(int fd, void* buf, size_t nbyte);
 
-/* fork */
+/* fork, after flushing stdio */
 extern int fork();
+extern int _fork();
 
 /* execl */
 extern int execl(const char *pathname, const char *arg, ...
                        /* (char  *) NULL */);
 
-/* shutdown */
+/* shutdown, after flushing stdio */
 extern void shutdown(void);
+extern void _shutdown(void);
 
 /* join */
 extern int join(void);
@@ -59,11 +62,15 @@ extern int open(char* path);
 //1022
 extern int close(int fd);
 
+//1037, 1 for the terminal, 0 for files and pipes, -1 for a bad fd
+extern int isatty(int fd);
+
 //1023
 extern int len(int fd);
 
-//1024
+//1024, after flushing stdout when fd is 0
 extern int read(int fd, void* buffer, unsigned count);
+extern int _read(int fd, void* buffer, unsigned count);
 
 //1026
 extern int pipe(int* write_fd, int* read_fd);
@@ -0,0 +1,147 @@
+#include "libc.h"
+
+// This test hammers the kernel's ready queue from several processes at once.
+// Run it with QEMU_SMP=1, 2, 4 and 8 to compare the cycle counts
+
+#define ROUNDS 200
+#define WORKERS 4
+#define UPS 100
+#define BYTES 64
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// two processes hand a token back and forth through a pair of semaphores
+void ping_pong(void)
+{
+    int ping = sem(0);
+    int pong = sem(0);
+
+    unsigned start = cycles();
+    int id = fork();
+    if (id == 0)
+    {
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            down(ping);
+            up(pong);
+        }
+        exit(0);
+    }
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        up(ping);
+        down(pong);
+    }
+    int rc = join();
+    unsigned total = cycles() - start;
+
+    printf("*** ping pong %s\n", rc == 0 ? "ok" : "failed");
+    printf("ping pong: %u cycles per round trip\n", total / ROUNDS);
+}
+
+// many processes wake up one waiter as fast as they can
+void fan_in(void)
+{
+    int s = sem(0);
+
+    unsigned start = cycles();
+    for (int w = 0; w < WORKERS; w++)
+    {
+        if (fork() == 0)
+        {
+            for (int i = 0; i < UPS; i++)
+            {
+                up(s);
+            }
+            exit(0);
+        }
+    }
+    for (int i = 0; i < WORKERS * UPS; i++)
+    {
+        down(s);
+    }
+    int bad = 0;
+    for (int w = 0; w < WORKERS; w++)
+    {
+        if (join() != 0)
+        {
+            bad = 1;
+        }
+    }
+    unsigned total = cycles() - start;
+
+    printf("*** fan in %s\n", bad ? "failed" : "ok");
+    printf("fan in: %u cycles per wakeup\n", total / (WORKERS * UPS));
+}
+
+// many writers share one pipe, every byte has to come out exactly once
+void pipe_fan_in(void)
+{
+    int write_fd;
+    int read_fd;
+    if (pipe(&write_fd, &read_fd) < 0)
+    {
+        printf("*** pipe failed\n");
+        return;
+    }
+
+    unsigned start = cycles();
+    for (int w = 0; w < WORKERS; w++)
+    {
+        if (fork() == 0)
+        {
+            char buf[BYTES];
+            memset(buf, 'a' + w, BYTES);
+            write(write_fd, buf, BYTES);
+            exit(0);
+        }
+    }
+
+    int counts[WORKERS] = {0};
+    int bad = 0;
+    char buf[BYTES];
+    for (int got = 0; got < WORKERS * BYTES; got += BYTES)
+    {
+        read(read_fd, buf, BYTES);
+        for (int i = 0; i < BYTES; i++)
+        {
+            int w = buf[i] - 'a';
+            if (w < 0 || w >= WORKERS)
+            {
+                bad = 1;
+            }
+            else
+            {
+                counts[w]++;
+            }
+        }
+    }
+    for (int w = 0; w < WORKERS; w++)
+    {
+        join();
+        if (counts[w] != BYTES)
+        {
+            bad = 1;
+        }
+    }
+    unsigned total = cycles() - start;
+
+    printf("*** pipe fan in %s\n", bad ? "failed" : "ok");
+    printf("pipe fan in: %u cycles per byte\n", total / (WORKERS * BYTES));
+}
+
+int main()
+{
+    printf("*** sched stress\n");
+    ping_pong();
+    fan_in();
+    pipe_fan_in();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
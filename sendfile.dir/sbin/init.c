@@ -0,0 +1,187 @@
+#include "libc.h"
+
+// sendfile moves file bytes into a pipe or the terminal, and pipe bytes
+// into another pipe, without them coming through our memory
+
+#define LINES 200
+#define LINE 64
+#define SIZE (LINES * LINE)
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// "line NNN " followed by letters starting NNN places into the alphabet
+int is_line(const char* p, int i)
+{
+    return p[0] == 'l' && p[5] == '0' + i / 100 && p[6] == '0' + i / 10 % 10 &&
+           p[7] == '0' + i % 10 && p[9] == 'a' + i % 26 && p[LINE - 1] == '\n';
+}
+
+// a child reads len bytes from r and checks them against the file from start
+void check_pipe(int r, int fd, unsigned start, unsigned len)
+{
+    if (fork() == 0)
+    {
+        static char got[SIZE];
+        static char want[SIZE];
+        int ok = read(r, got, len) == (int)len && pread(fd, want, len, start) == (int)len;
+        for (unsigned i = 0; ok && i < len; i++)
+        {
+            ok = got[i] == want[i];
+        }
+        exit(ok);
+    }
+}
+
+// the whole file in one call, and the offset we share with the child moves
+void to_pipe(void)
+{
+    int fd = open("/lines.txt");
+    int w, r;
+    pipe(&w, &r);
+    check_pipe(r, fd, 0, SIZE);
+    int n = sendfile(w, fd, 0, SIZE + 100);
+    int ok = join() == 1 && n == SIZE && lseek(fd, 0, SEEK_CUR) == SIZE;
+
+    char buf[LINE];
+    ok = ok && pread(fd, buf, LINE, 150 * LINE) == LINE && is_line(buf, 150);
+    close(w);
+    close(r);
+    close(fd);
+    printf("*** to pipe %s\n", ok ? "ok" : "failed");
+}
+
+// from the middle of a line across two page boundaries, and off the end
+void at_offset(void)
+{
+    int fd = open("/lines.txt");
+    int w, r;
+    pipe(&w, &r);
+    unsigned start = 3 * LINE + 10;
+    unsigned len = 2 * 4096 + 100;
+    unsigned off = start;
+    check_pipe(r, fd, start, len);
+    int n = sendfile(w, fd, &off, len);
+    int ok = join() == 1 && n == (int)len && off == start + len &&
+             lseek(fd, 0, SEEK_CUR) == 0;
+
+    off = SIZE - 5;
+    check_pipe(r, fd, off, 5);
+    ok = ok && sendfile(w, fd, &off, 100) == 5 && join() == 1 && off == SIZE;
+    ok = ok && sendfile(w, fd, &off, 100) == 0 && off == SIZE;
+    close(w);
+    close(r);
+    close(fd);
+    printf("*** offset %s\n", ok ? "ok" : "failed");
+}
+
+void pipe_to_pipe(void)
+{
+    int w1, r1, w2, r2;
+    pipe(&w1, &r1);
+    pipe(&w2, &r2);
+    const char* msg = "from one pipe into the other";
+    int len = strlen(msg);
+    if (fork() == 0)
+    {
+        exit(write(w1, (void*)msg, len) == len);
+    }
+    unsigned off = 0;
+    int n = sendfile(w2, r1, 0, len);
+    char got[40] = { 0 };
+    int ok = n == len && read(r2, got, len) == len && strcmp(got, msg) == 0 &&
+             join() == 1 && sendfile(w2, r1, &off, 1) == -1;
+    close(w1);
+    close(r1);
+    close(w2);
+    close(r2);
+    printf("*** pipe to pipe %s\n", ok ? "ok" : "failed");
+}
+
+// the file holds the line this prints
+void to_terminal(void)
+{
+    int fd = open("/banner.txt");
+    fflush(stdout);
+    int n = sendfile(1, fd, 0, 100);
+    close(fd);
+    if (n != 16)
+    {
+        printf("*** terminal returned %d\n", n);
+    }
+}
+
+void bad_sends(void)
+{
+    int fd = open("/lines.txt");
+    int other = open("/banner.txt");
+    int w, r;
+    pipe(&w, &r);
+
+    int ok = sendfile(other, fd, 0, 10) == -1 &&
+             sendfile(9, fd, 0, 10) == -1 &&
+             sendfile(w, 9, 0, 10) == -1 &&
+             sendfile(r, fd, 0, 10) == -1 &&
+             sendfile(w, w, 0, 10) == -1 &&
+             sendfile(w, fd, (unsigned*)0x1000, 10) == -1 &&
+             sendfile(w, fd, 0, 0) == 0 &&
+             lseek(fd, 0, SEEK_CUR) == 0;
+
+    close(w);
+    close(r);
+    close(other);
+    close(fd);
+    printf("*** bad %s\n", ok ? "ok" : "failed");
+}
+
+// the whole file through a pipe a child drains, like cat would and with sendfile
+unsigned time_copy(int kernel)
+{
+    int fd = open("/lines.txt");
+    int w, r;
+    pipe(&w, &r);
+    if (fork() == 0)
+    {
+        static char sink[SIZE];
+        exit(read(r, sink, SIZE) == SIZE);
+    }
+    unsigned start = cycles();
+    if (kernel)
+    {
+        sendfile(w, fd, 0, SIZE);
+    }
+    else
+    {
+        static char buf[4096];
+        int n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+        {
+            write(w, buf, n);
+        }
+    }
+    unsigned total = cycles() - start;
+    join();
+    close(w);
+    close(r);
+    close(fd);
+    return total / SIZE;
+}
+
+int main()
+{
+    printf("*** sendfile\n");
+    to_pipe();
+    at_offset();
+    pipe_to_pipe();
+    to_terminal();
+    bad_sends();
+    printf("read and write: %u cycles per byte\n", time_copy(0));
+    printf("sendfile: %u cycles per byte\n", time_copy(1));
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "libc.h"
+
+// stdout is line buffered on the terminal, a FILE on a pipe waits for a
+// full buffer or a flush, and nothing buffered is lost on exit
+
+#define CHARS 3000
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+void tty(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    int ok = isatty(1) == 1 && isatty(w) == 0 && isatty(r) == 0 && isatty(-1) == -1;
+    close(w);
+    close(r);
+    printf("*** isatty %s\n", ok ? "ok" : "failed");
+}
+
+// the header went out at its newline, stdout knows it is a terminal
+void line_buffered(void)
+{
+    int ok = stdout->mode == _IOLBF && stdout->len == 0;
+    printf("*** line ");
+    ok = ok && stdout->len == 9;
+    printf("%s\n", ok ? "ok" : "failed");
+}
+
+// more than a buffer's worth through a pipe arrives whole and in order
+void through_pipe(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    if (fork() == 0)
+    {
+        FILE* f = fdopen(w, "w");
+        for (int i = 0; i < CHARS; i++)
+        {
+            fputc('a' + i % 26, f);
+        }
+        fclose(f);
+        exit(0);
+    }
+    static char got[CHARS];
+    int n = read(r, got, CHARS);
+    join();
+    close(w);
+    close(r);
+
+    int ok = n == CHARS;
+    for (int i = 0; ok && i < CHARS; i++)
+    {
+        ok = got[i] == 'a' + i % 26;
+    }
+    printf("*** pipe %s\n", ok ? "ok" : "failed");
+}
+
+// the child never flushes, exit does it
+void exit_flush(void)
+{
+    int w, r;
+    pipe(&w, &r);
+    const char* msg = "buffered until exit";
+    int n = strlen(msg);
+    if (fork() == 0)
+    {
+        FILE* f = fdopen(w, "w");
+        fputs(msg, f);
+        exit(0);
+    }
+    char got[32] = { 0 };
+    int rc = read(r, got, n);
+    join();
+    close(w);
+    close(r);
+    printf("*** exit flush %s\n", rc == n && strcmp(got, msg) == 0 ? "ok" : "failed");
+}
+
+// cycles per character written to a pipe that a child drains
+unsigned time_pipe(int mode)
+{
+    int w, r;
+    pipe(&w, &r);
+    if (fork() == 0)
+    {
+        char buf[100];
+        for (int done = 0; done < CHARS; done += sizeof(buf))
+        {
+            read(r, buf, sizeof(buf));
+        }
+        exit(0);
+    }
+    FILE* f = fdopen(w, "w");
+    setvbuf(f, 0, mode, 0);
+    unsigned start = cycles();
+    for (int i = 0; i < CHARS; i++)
+    {
+        fputc('x', f);
+    }
+    fflush(f);
+    unsigned total = cycles() - start;
+    join();
+    fclose(f);
+    close(r);
+    return total / CHARS;
+}
+
+int main()
+{
+    printf("*** stdio\n");
+    line_buffered();
+    tty();
+    through_pipe();
+    exit_flush();
+    printf("unbuffered: %u cycles per char\n", time_pipe(_IONBF));
+    printf("buffered: %u cycles per char\n", time_pipe(_IOFBF));
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
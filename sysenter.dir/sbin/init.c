@@ -0,0 +1,107 @@
+#include "libc.h"
+
+// System calls go through sysenter when the CPU has it, every printf
+// below included. Clearing fast_syscalls sends them through int $48
+
+#define CALLS 20000
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// plain calls come back with the right result
+void results(void)
+{
+    int n = write(1, "hello\n", 6);
+    int word = 0;
+    int woke = futex_wake(&word, 1);
+    printf("*** results %s\n", n == 6 && woke == 0 ? "ok" : "failed");
+}
+
+// the child resumes through iret on a frame sysenter built
+void fork_join(void)
+{
+    int before = 1234;
+    int id = fork();
+    if (id == 0)
+    {
+        exit(before + 1);
+    }
+    int rc = join();
+    printf("*** fork %s\n", id > 0 && rc == 1235 && before == 1234 ? "ok" : "failed");
+}
+
+// down blocks, so it returns long after its sysenter and not through sysexit
+void blocking(void)
+{
+    int s = sem(0);
+    if (fork() == 0)
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            yield();
+        }
+        up(s);
+        exit(0);
+    }
+    int marker = 77;
+    int rc = down(s);
+    join();
+    printf("*** block %s\n", rc == 0 && marker == 77 ? "ok" : "failed");
+}
+
+unsigned time_calls(void)
+{
+    int word = 0;
+    int woke = 0;
+    unsigned start = cycles();
+    for (int i = 0; i < CALLS; i++)
+    {
+        woke += futex_wake(&word, 1);
+    }
+    unsigned total = cycles() - start;
+    return woke == 0 ? total / CALLS : 0;
+}
+
+// same calls both ways, and int $48 still works
+void both_ways(void)
+{
+    int fast = fast_syscalls;
+    unsigned fast_cycles = time_calls();
+
+    fast_syscalls = 0;
+    unsigned slow_cycles = time_calls();
+    int n = write(1, "int $48\n", 8);
+    int id = fork();
+    if (id == 0)
+    {
+        exit(5);
+    }
+    int rc = join();
+    fast_syscalls = fast;
+
+    if (fast)
+    {
+        printf("sysenter: %u cycles per call\n", fast_cycles);
+    }
+    printf("int $48: %u cycles per call\n", slow_cycles);
+
+    int ok = fast_cycles != 0 && slow_cycles != 0 && n == 8 && rc == 5;
+    printf("*** fallback %s\n", ok ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** sysenter\n");
+    printf("fast system calls %s\n", fast_syscalls ? "on" : "off");
+    results();
+    fork_join();
+    blocking();
+    both_ways();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}
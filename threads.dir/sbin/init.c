@@ -0,0 +1,190 @@
+#include "libc.h"
+
+// Threads of one process share its memory, so plain globals and the
+// heap are visible to all of them without going through VA_USER_SHARED
+
+#define THREADS 4
+#define N 40000
+#define INCREMENTS 2000
+#define STACK 4096
+
+static char stacks[THREADS][STACK];
+static int numbers[N];
+
+static struct mutex m = { 0 };
+static struct cond c = { 0 };
+static int counter;
+static int go;
+static int* late;
+
+unsigned cycles(void)
+{
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+// each thread sums its own slice and bumps a shared counter
+int sum_slice(void* arg)
+{
+    int t = (int)arg;
+    int sum = 0;
+    for (int i = t * (N / THREADS); i < (t + 1) * (N / THREADS); i++)
+    {
+        sum += numbers[i];
+    }
+    for (int i = 0; i < INCREMENTS; i++)
+    {
+        mutex_lock(&m);
+        counter = counter + 1;
+        mutex_unlock(&m);
+    }
+    return sum;
+}
+
+void parallel_sum(void)
+{
+    int expected = 0;
+    for (int i = 0; i < N; i++)
+    {
+        numbers[i] = i % 97;
+        expected += numbers[i];
+    }
+    counter = 0;
+
+    unsigned start = cycles();
+    int tids[THREADS];
+    for (int t = 0; t < THREADS; t++)
+    {
+        tids[t] = spawn_thread(sum_slice, (void*)t, stacks[t], STACK);
+    }
+    int sum = 0;
+    int ok = 1;
+    for (int t = 0; t < THREADS; t++)
+    {
+        ok = ok && tids[t] > 0;
+        sum += thread_join(tids[t]);
+    }
+    unsigned total = cycles() - start;
+
+    ok = ok && sum == expected && counter == THREADS * INCREMENTS;
+    printf("*** sum %s\n", ok ? "ok" : "failed");
+    printf("sum: %u cycles for %d threads\n", total, THREADS);
+}
+
+// waits for the main thread, then writes to memory mapped after it started
+int waiter(void* arg)
+{
+    mutex_lock(&m);
+    while (!go)
+    {
+        cond_wait(&c, &m);
+    }
+    mutex_unlock(&m);
+    late[100] = 42;
+    return 7;
+}
+
+void shared_mappings(void)
+{
+    go = 0;
+    int tid = spawn_thread(waiter, 0, stacks[0], STACK);
+
+    // a thread is running, so the memory can't be copied out from under it
+    // or replaced by another program
+    int forked = fork();
+    int execed = execl("/sbin/init", "init", 0);
+
+    late = (int*)simple_mmap(0, 8192, -1, 0);
+    struct memstats before;
+    memstats(MEMSTATS_SELF, &before);
+    mutex_lock(&m);
+    go = 1;
+    cond_broadcast(&c);
+    mutex_unlock(&m);
+
+    int rc = thread_join(tid);
+
+    // the waiter's fault on late counts for the whole process
+    struct memstats after;
+    memstats(MEMSTATS_SELF, &after);
+
+    int again = thread_join(tid);
+    int creator = thread_join(0);
+
+    int ok = forked == -1 && execed == -1 && late != 0 && after.faults > before.faults && late[100] == 42 && rc == 7 && again == -1 && creator == -1;
+    printf("*** shared %s\n", ok ? "ok" : "failed");
+}
+
+// with the threads gone, fork works again
+void fork_after(void)
+{
+    int id = fork();
+    if (id == 0)
+    {
+        exit(counter == THREADS * INCREMENTS ? 3 : 4);
+    }
+    int rc = join();
+    printf("*** fork %s\n", id > 0 && rc == 3 ? "ok" : "failed");
+}
+
+static int never;
+static int blocked;
+static int pipe_fds[2];
+
+// waits on a futex nobody will ever wake
+int futex_sleeper(void* arg)
+{
+    __atomic_add_fetch(&blocked, 1, __ATOMIC_SEQ_CST);
+    futex_wait(&never, 0);
+    return 1;
+}
+
+// reads a pipe nobody writes to
+int pipe_reader(void* arg)
+{
+    char c;
+    __atomic_add_fetch(&blocked, 1, __ATOMIC_SEQ_CST);
+    read(pipe_fds[1], &c, 1);
+    return 2;
+}
+
+int spinner(void* arg)
+{
+    __atomic_add_fetch(&blocked, 1, __ATOMIC_SEQ_CST);
+    while (1)
+    {
+    }
+    return 3;
+}
+
+// the creator's exit ends the process even with its threads stuck or busy
+void exit_with_threads(void)
+{
+    int id = fork();
+    if (id == 0)
+    {
+        pipe(&pipe_fds[0], &pipe_fds[1]);
+        spawn_thread(futex_sleeper, 0, stacks[0], STACK);
+        spawn_thread(pipe_reader, 0, stacks[1], STACK);
+        spawn_thread(spinner, 0, stacks[2], STACK);
+        while (__atomic_load_n(&blocked, __ATOMIC_SEQ_CST) < 3)
+        {
+        }
+        exit(5);
+    }
+    int rc = join();
+    printf("*** exit %s\n", id > 0 && rc == 5 ? "ok" : "failed");
+}
+
+int main()
+{
+    printf("*** threads\n");
+    parallel_sum();
+    shared_mappings();
+    fork_after();
+    exit_with_threads();
+    printf("*** done\n");
+    shutdown();
+    return 0;
+}